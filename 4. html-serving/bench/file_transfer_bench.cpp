@@ -0,0 +1,198 @@
+// HTTPS download throughput benchmark.
+//
+// Keeps N keep-alive connections downloading the same file for a fixed
+// time and reports requests, MB/s and the negotiated cipher. Run it once
+// against the Crow port and once against the kTLS file port with a large
+// file in public/ to compare userspace encryption with kernel offload:
+//
+//   head -c 256M /dev/urandom > public/big.bin
+//   ./file_transfer_bench 127.0.0.1 8443 /big.bin 10 4
+//   ./file_transfer_bench 127.0.0.1 8444 /big.bin 10 4
+//
+// Usage: file_transfer_bench [host] [port] [path] [seconds] [connections]
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+    int connect_tcp(const std::string &host, const std::string &port)
+    {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        addrinfo *addresses = nullptr;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0)
+        {
+            return -1;
+        }
+
+        int fd = -1;
+        for (addrinfo *a = addresses; a != nullptr && fd < 0; a = a->ai_next)
+        {
+            fd = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+            if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) < 0)
+            {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(addresses);
+        return fd;
+    }
+
+    struct Totals
+    {
+        std::atomic<long> requests{0};
+        std::atomic<long long> body_bytes{0};
+        std::atomic<long> failures{0};
+    };
+
+    // Reads one response and discards its body; false on error
+    bool read_response(SSL *ssl, std::string &head, long long &body_bytes)
+    {
+        char chunk[64 * 1024];
+        std::size_t head_end;
+        while ((head_end = head.find("\r\n\r\n")) == std::string::npos)
+        {
+            int n = SSL_read(ssl, chunk, sizeof(chunk));
+            if (n <= 0)
+            {
+                return false;
+            }
+            head.append(chunk, static_cast<std::size_t>(n));
+        }
+        if (head.compare(0, 12, "HTTP/1.1 200") != 0)
+        {
+            return false;
+        }
+
+        std::size_t field = head.find("Content-Length:");
+        if (field == std::string::npos)
+        {
+            field = head.find("content-length:");
+        }
+        if (field == std::string::npos || field > head_end)
+        {
+            return false;
+        }
+        long long remaining = std::strtoll(head.c_str() + field + 15, nullptr, 10);
+        body_bytes = remaining;
+
+        // Part of the body may have arrived with the head
+        long long buffered = static_cast<long long>(head.size() - (head_end + 4));
+        if (buffered > remaining)
+        {
+            head.erase(0, head_end + 4 + remaining);
+            return true;
+        }
+        remaining -= buffered;
+        head.clear();
+        while (remaining > 0)
+        {
+            int n = SSL_read(ssl, chunk, static_cast<int>(std::min<long long>(remaining, sizeof(chunk))));
+            if (n <= 0)
+            {
+                return false;
+            }
+            remaining -= n;
+        }
+        return true;
+    }
+
+    void run_connection(SSL_CTX *ctx, const std::string &host, const std::string &port, const std::string &path,
+                        std::chrono::steady_clock::time_point deadline, Totals &totals, bool describe)
+    {
+        int fd = connect_tcp(host, port);
+        if (fd < 0)
+        {
+            ++totals.failures;
+            return;
+        }
+        SSL *ssl = SSL_new(ctx);
+        SSL_set_fd(ssl, fd);
+        SSL_set_tlsext_host_name(ssl, host.c_str());
+
+        if (SSL_connect(ssl) == 1)
+        {
+            if (describe)
+            {
+                std::printf("negotiated %s %s\n", SSL_get_version(ssl), SSL_get_cipher_name(ssl));
+            }
+
+            std::string request = "GET " + path + " HTTP/1.1\r\nHost: " + host + "\r\n\r\n";
+            std::string head;
+            while (std::chrono::steady_clock::now() < deadline)
+            {
+                long long body_bytes = 0;
+                if (SSL_write(ssl, request.data(), static_cast<int>(request.size())) <= 0 ||
+                    !read_response(ssl, head, body_bytes))
+                {
+                    ++totals.failures;
+                    break;
+                }
+                ++totals.requests;
+                totals.body_bytes += body_bytes;
+            }
+            SSL_shutdown(ssl);
+        }
+        else
+        {
+            ++totals.failures;
+            ERR_print_errors_fp(stderr);
+        }
+        SSL_free(ssl);
+        close(fd);
+    }
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::string host = argc > 1 ? argv[1] : "127.0.0.1";
+    std::string port = argc > 2 ? argv[2] : "8444";
+    std::string path = argc > 3 ? argv[3] : "/index.html";
+    double seconds = argc > 4 ? std::atof(argv[4]) : 10.0;
+    int connections = argc > 5 ? std::atoi(argv[5]) : 4;
+
+    // The example uses a self-signed certificate, so the peer is not verified
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
+
+    Totals totals;
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                std::chrono::duration<double>(seconds));
+    std::vector<std::thread> threads;
+    for (int i = 0; i < connections; ++i)
+    {
+        threads.emplace_back(run_connection, ctx, host, port, path, deadline, std::ref(totals), i == 0);
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("%-6s %10s %12s %10s %8s\n", "conns", "requests", "MB", "MB/s", "failed");
+    std::printf("%-6d %10ld %12.1f %10.1f %8ld\n", connections, totals.requests.load(),
+                static_cast<double>(totals.body_bytes.load()) / 1e6,
+                static_cast<double>(totals.body_bytes.load()) / 1e6 / elapsed, totals.failures.load());
+
+    SSL_CTX_free(ctx);
+    return 0;
+}
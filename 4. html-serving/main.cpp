@@ -1,10 +1,20 @@
 #include "crow.h"
+#include "json_template.h"
+#include "coarse_clock.h"
+#include "tls_session.h"
+#include "tls_reload.h"
+#include "tls_ocsp.h"
+#include "https_redirect.h"
+#include "ktls_file_server.h"
+#include "route_metrics.h"
+#include <cerrno>
+#include <cstdlib>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <ctime>
-#include <thread>
-#include <chrono>
+#include <memory>
+#include <vector>
 
 std::string load_file(const std::string& filepath) {
     std::ifstream file(filepath);
@@ -39,73 +49,67 @@ std::string get_mime_type(const std::string& filepath) {
     return "text/plain";
 }
 
-void start_http_redirect_server() {
-    crow::SimpleApp http_app;
-    
-    // Catch all HTTP requests and redirect to HTTPS
-    CROW_ROUTE(http_app, "/<path>")
-    ([](const crow::request& req, const std::string& path){
-        std::string host = req.get_header_value("Host");
-        if (!host.empty()) {
-            size_t colon_pos = host.find(':');
-            if (colon_pos != std::string::npos) {
-                host = host.substr(0, colon_pos);
-            }
-        } else {
-            host = "localhost";
-        }
-        
-        std::string redirect_url = "https://" + host + ":8443" + req.url;
-        crow::response res(301);
-        res.add_header("Location", redirect_url);
-        return res;
-    });
-    
-    // Root path redirection
-    CROW_ROUTE(http_app, "/")
-    ([](const crow::request& req){
-        std::string host = req.get_header_value("Host");
-        if (!host.empty()) {
-            size_t colon_pos = host.find(':');
-            if (colon_pos != std::string::npos) {
-                host = host.substr(0, colon_pos);
-            }
-        } else {
-            host = "localhost";
-        }
-        
-        std::string redirect_url = "https://" + host + ":8443/";
-        crow::response res(301);
-        res.add_header("Location", redirect_url);
-        return res;
-    });
-    
-    std::cout << "Starting HTTP redirect server on port 8080..." << std::endl;
-    http_app.port(8080).multithreaded().run();
+// Plain HTTP requests get a 301 to the same host and path on HTTPS
+const unsigned short http_port = 8080;
+const unsigned short https_port = 8443;
+
+// Large downloads can be served with kernel TLS offload on a separate
+// port by setting KTLS_FILE_PORT (e.g. 8444); unset or empty leaves it
+// off, and anything but a port number is reported and leaves it off too
+unsigned short ktls_file_port() {
+    const char* port = std::getenv("KTLS_FILE_PORT");
+    if (!port || !*port) return 0;
+    char* end = nullptr;
+    errno = 0;
+    long value = std::strtol(port, &end, 10);
+    if (errno != 0 || *end != '\0' || value < 1 || value > 65535) {
+        std::cerr << "Ignoring KTLS_FILE_PORT=\"" << port
+                  << "\": expected a port number from 1 to 65535" << std::endl;
+        return 0;
+    }
+    return static_cast<unsigned short>(value);
 }
 
 int main() {
     std::cout << "HTML Server with HTTP to HTTPS redirection" << std::endl;
     std::cout << "=========================================" << std::endl;
     
-    // Start HTTP redirect server in a separate thread
-    std::thread http_thread(start_http_redirect_server);
-    
-    // Give HTTP server time to start
-    std::this_thread::sleep_for(std::chrono::milliseconds(500));
-    
-    // Main HTTPS server
-    crow::SimpleApp https_app;
+    // One asio thread answers every HTTP request with a redirect; the
+    // port is bound here, so it is listening before HTTPS starts
+    https_redirect::Options redirect_options;
+    redirect_options.http_port = http_port;
+    redirect_options.https_port = https_port;
+    std::unique_ptr<https_redirect::Redirector> redirector;
+    try {
+        redirector.reset(new https_redirect::Redirector(redirect_options));
+    } catch (const std::exception& e) {
+        std::cerr << "HTTP redirect server error: " << e.what() << std::endl;
+        return 1;
+    }
+    redirector->start();
+    
+    // Main HTTPS server. Per-route counts and latency histograms are
+    // served at /metrics; routes are declared in the same order as below.
+    crow::App<metrics::Middleware> https_app;
+    https_app.get_middleware<metrics::Middleware>()
+        .route("/api/status")
+        .route("/")
+        .route("/style.css")
+        .route("/app.js")
+        .route("/about.html")
+        .route("/<path>");
+    
+    // Status body is serialized once; only the timestamp changes per request
+    const auto status_json = fastjson::Template::Builder()
+                                 .field("status", "ok")
+                                 .field("server", "HTML Server with HTTPS")
+                                 .slot("timestamp")
+                                 .build();
     
     // API endpoint - MUST come before the catch-all route
     CROW_ROUTE(https_app, "/api/status")
-    ([](){
-        crow::json::wvalue response;
-        response["status"] = "ok";
-        response["server"] = "HTML Server with HTTPS";
-        response["timestamp"] = std::time(nullptr);
-        
-        crow::response res(200, response.dump());
+    ([&status_json](){
+        crow::response res(200, status_json.render(coarse_clock::now_seconds()));
         res.add_header("Content-Type", "application/json");
         res.add_header("Access-Control-Allow-Origin", "*");
         return res;
@@ -163,13 +167,54 @@ int main() {
         return res;
     });
     
-    std::cout << "Starting HTTPS server on port 8443..." << std::endl;
-    std::cout << "Visit: https://localhost:8443" << std::endl;
-    std::cout << "HTTP redirect available at: http://localhost:8080" << std::endl;
+    std::cout << "Starting HTTPS server on port " << https_port << "..." << std::endl;
+    std::cout << "Visit: https://localhost:" << https_port << std::endl;
+    std::cout << "HTTP redirect available at: http://localhost:" << http_port << std::endl;
+    
+    // Same setup as ssl_file(), plus session resumption so returning
+    // browsers skip the full handshake
+    asio::ssl::context ssl_ctx(asio::ssl::context::sslv23);
     
     try {
-        https_app.port(8443)
-                 .ssl_file("server.crt", "server.key")
+        ssl_ctx.use_certificate_chain_file("server.crt");
+        ssl_ctx.use_private_key_file("server.key", asio::ssl::context::pem);
+        ssl_ctx.set_options(asio::ssl::context::default_workarounds |
+                            asio::ssl::context::no_sslv2 |
+                            asio::ssl::context::no_sslv3);
+        tls::enable_session_resumption(ssl_ctx.native_handle());
+
+        // OCSP responses for the certificate are fetched in the background
+        // and stapled into handshakes from memory
+        tls::OcspStapler ocsp_stapler;
+
+        // Renewed server.crt/server.key are validated and swapped in for
+        // new handshakes; open connections keep the old certificate
+        const std::vector<tls::CertificateFiles> certificates{{"server.crt", "server.key"}};
+        tls::CertificateStore certificate_store(ssl_ctx.native_handle());
+        certificate_store.set_listener([&ocsp_stapler](const std::string& pattern, SSL_CTX* ctx)
+                                       { ocsp_stapler.attach(pattern, ctx); });
+        certificate_store.add("*", certificates, tls::Validity::Warn);
+        certificate_store.install();
+        tls::CertificateWatcher certificate_watcher(certificate_store);
+        certificate_watcher.watch("*", certificates);
+        certificate_watcher.start();
+        ocsp_stapler.start();
+        
+        // Shares ssl_ctx, so reloads and stapling apply here too
+        std::unique_ptr<ktls::FileServer> file_server;
+        if (unsigned short port = ktls_file_port()) {
+            ktls::Options file_options;
+            file_options.port = port;
+            file_server.reset(new ktls::FileServer(ssl_ctx.native_handle(), file_options));
+            file_server->start();
+            std::cout << "Static files on https://localhost:" << port << " ("
+                      << (ktls::kernel_supports_ktls() ? "kernel TLS offload"
+                                                       : "no kernel TLS, userspace fallback")
+                      << ")" << std::endl;
+        }
+        
+        https_app.port(https_port)
+                 .ssl(std::move(ssl_ctx))
                  .multithreaded()
                  .run();
     } catch (const std::exception& e) {
@@ -177,8 +222,7 @@ int main() {
         return 1;
     }
     
-    // Wait for HTTP thread to finish
-    http_thread.join();
+    redirector->stop();
     
     return 0;
 }
@@ -0,0 +1,356 @@
+// TLS handshake benchmark.
+//
+// Opens one HTTPS connection after another against a running server, sends
+// a single GET and closes, first always starting a fresh session (full
+// handshakes), then offering the session from the previous connection
+// (resumed handshakes). Reports connections per second, handshake latency
+// (TCP connect to handshake done) and how many offered sessions the server
+// actually resumed, after printing what was negotiated. Run it once per
+// server TLS profile to compare them.
+//
+// With a storm thread count, it then measures request latency on one
+// established keep-alive connection, first alone and then while that many
+// threads run full handshakes against the same server. That shows how
+// much a reconnect storm delays requests on connections that are already
+// up.
+//
+// Usage: tls_handshake_bench [host] [port] [seconds per mode] [path] [tls1.2|tls1.3|any] [storm threads]
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+    int connect_tcp(const std::string &host, const std::string &port)
+    {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        addrinfo *addresses = nullptr;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0)
+        {
+            return -1;
+        }
+
+        int fd = -1;
+        for (addrinfo *a = addresses; a != nullptr && fd < 0; a = a->ai_next)
+        {
+            fd = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+            if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) < 0)
+            {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(addresses);
+
+        if (fd >= 0)
+        {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        return fd;
+    }
+
+    void print_negotiated(SSL *ssl)
+    {
+        std::string group = "-";
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        if (const char *name = SSL_group_to_name(ssl, SSL_get_negotiated_group(ssl)))
+        {
+            group = name;
+        }
+#endif
+        std::string key = "-";
+        if (X509 *certificate = SSL_get_peer_certificate(ssl))
+        {
+            int type = EVP_PKEY_base_id(X509_get0_pubkey(certificate));
+            key = type == EVP_PKEY_EC ? "ECDSA" : type == EVP_PKEY_RSA ? "RSA" : OBJ_nid2sn(type);
+            X509_free(certificate);
+        }
+        std::printf("negotiated %s %s, group %s, %s certificate\n", SSL_get_version(ssl),
+                    SSL_get_cipher_name(ssl), group.c_str(), key.c_str());
+    }
+
+    // One connection: handshake, GET, read to close. Returns the session to
+    // offer next time (null on failure), whether this one was resumed and
+    // how long the TCP and TLS handshakes took.
+    SSL_SESSION *run_connection(SSL_CTX *ctx, const std::string &host, const std::string &port,
+                                const std::string &request, SSL_SESSION *offer, bool &resumed,
+                                double &handshake_ms, bool describe)
+    {
+        auto start = std::chrono::steady_clock::now();
+        int fd = connect_tcp(host, port);
+        if (fd < 0)
+        {
+            return nullptr;
+        }
+
+        SSL *ssl = SSL_new(ctx);
+        SSL_set_fd(ssl, fd);
+        SSL_set_tlsext_host_name(ssl, host.c_str());
+        if (offer != nullptr)
+        {
+            SSL_set_session(ssl, offer);
+        }
+
+        SSL_SESSION *session = nullptr;
+        if (SSL_connect(ssl) == 1)
+        {
+            handshake_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            resumed = SSL_session_reused(ssl) == 1;
+            if (describe)
+            {
+                print_negotiated(ssl);
+            }
+
+            // Reading the response also processes TLS 1.3 tickets, which
+            // arrive after the handshake
+            char buffer[4096];
+            if (SSL_write(ssl, request.data(), static_cast<int>(request.size())) > 0)
+            {
+                while (SSL_read(ssl, buffer, sizeof(buffer)) > 0)
+                {
+                }
+            }
+            session = SSL_get1_session(ssl);
+            SSL_shutdown(ssl);
+        }
+        else
+        {
+            ERR_print_errors_fp(stderr);
+        }
+
+        SSL_free(ssl);
+        close(fd);
+        return session;
+    }
+
+    void run_mode(SSL_CTX *ctx, const std::string &host, const std::string &port, const std::string &request,
+                  double seconds, bool resume)
+    {
+        long connections = 0;
+        long resumed_count = 0;
+        long failures = 0;
+        std::vector<double> latencies;
+        SSL_SESSION *session = nullptr;
+
+        auto start = std::chrono::steady_clock::now();
+        auto deadline = start + std::chrono::duration<double>(seconds);
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            bool resumed = false;
+            double handshake_ms = 0;
+            SSL_SESSION *next = run_connection(ctx, host, port, request, resume ? session : nullptr, resumed,
+                                               handshake_ms, !resume && connections == 0 && failures == 0);
+            if (next == nullptr)
+            {
+                ++failures;
+                continue;
+            }
+
+            ++connections;
+            resumed_count += resumed ? 1 : 0;
+            latencies.push_back(handshake_ms);
+
+            // A TLS 1.3 connection that closes before its ticket arrives
+            // leaves a session that cannot be offered; keep the last one
+            if (SSL_SESSION_is_resumable(next))
+            {
+                SSL_SESSION_free(session);
+                session = next;
+            }
+            else
+            {
+                SSL_SESSION_free(next);
+            }
+        }
+        SSL_SESSION_free(session);
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double p)
+        {
+            return latencies.empty() ? 0.0 : latencies[static_cast<std::size_t>(p * (latencies.size() - 1))];
+        };
+        std::printf("%-8s %10ld %12.1f %10ld %8ld %9.3f %9.3f\n", resume ? "resumed" : "full", connections,
+                    static_cast<double>(connections) / elapsed, resumed_count, failures,
+                    percentile(0.50), percentile(0.99));
+    }
+
+    // Reads one response with a Content-Length body; false on error
+    bool read_response(SSL *ssl, std::string &buffer)
+    {
+        while (true)
+        {
+            std::size_t head_end = buffer.find("\r\n\r\n");
+            if (head_end != std::string::npos)
+            {
+                std::size_t length = 0;
+                std::size_t field = buffer.find("Content-Length:");
+                if (field == std::string::npos)
+                {
+                    field = buffer.find("content-length:");
+                }
+                if (field != std::string::npos && field < head_end)
+                {
+                    length = std::strtoul(buffer.c_str() + field + 15, nullptr, 10);
+                }
+                if (buffer.size() >= head_end + 4 + length)
+                {
+                    buffer.erase(0, head_end + 4 + length);
+                    return true;
+                }
+            }
+
+            char chunk[4096];
+            int n = SSL_read(ssl, chunk, sizeof(chunk));
+            if (n <= 0)
+            {
+                return false;
+            }
+            buffer.append(chunk, static_cast<std::size_t>(n));
+        }
+    }
+
+    // Request latency on one keep-alive connection while storm_threads
+    // threads keep running full handshakes
+    void run_request_latency(SSL_CTX *ctx, const std::string &host, const std::string &port, const std::string &path,
+                             double seconds, int storm_threads)
+    {
+        std::atomic<bool> stop{false};
+        std::atomic<long> storm_handshakes{0};
+        std::vector<std::thread> storm;
+        std::string close_request = "GET " + path + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: close\r\n\r\n";
+        for (int i = 0; i < storm_threads; ++i)
+        {
+            storm.emplace_back([&]
+                               {
+                                   while (!stop.load(std::memory_order_relaxed))
+                                   {
+                                       bool resumed = false;
+                                       double handshake_ms = 0;
+                                       SSL_SESSION *session = run_connection(ctx, host, port, close_request, nullptr,
+                                                                             resumed, handshake_ms, false);
+                                       if (session != nullptr)
+                                       {
+                                           storm_handshakes.fetch_add(1, std::memory_order_relaxed);
+                                           SSL_SESSION_free(session);
+                                       }
+                                   } });
+        }
+
+        std::vector<double> latencies;
+        long failures = 0;
+        int fd = connect_tcp(host, port);
+        SSL *ssl = fd < 0 ? nullptr : SSL_new(ctx);
+        if (ssl != nullptr)
+        {
+            SSL_set_fd(ssl, fd);
+            SSL_set_tlsext_host_name(ssl, host.c_str());
+        }
+        if (ssl != nullptr && SSL_connect(ssl) == 1)
+        {
+            std::string request = "GET " + path + " HTTP/1.1\r\nHost: " + host + "\r\n\r\n";
+            std::string buffer;
+            auto start = std::chrono::steady_clock::now();
+            auto deadline = start + std::chrono::duration<double>(seconds);
+            while (std::chrono::steady_clock::now() < deadline)
+            {
+                auto sent = std::chrono::steady_clock::now();
+                if (SSL_write(ssl, request.data(), static_cast<int>(request.size())) <= 0 ||
+                    !read_response(ssl, buffer))
+                {
+                    ++failures;
+                    break;
+                }
+                latencies.push_back(
+                    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sent).count());
+            }
+            SSL_shutdown(ssl);
+        }
+        else
+        {
+            ++failures;
+            ERR_print_errors_fp(stderr);
+        }
+        SSL_free(ssl);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+
+        stop = true;
+        for (auto &thread : storm)
+        {
+            thread.join();
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double p)
+        {
+            return latencies.empty() ? 0.0 : latencies[static_cast<std::size_t>(p * (latencies.size() - 1))];
+        };
+        std::printf("%-8s %8d %12.1f %10zu %8ld %9.3f %9.3f %9.3f\n", storm_threads > 0 ? "storm" : "idle",
+                    storm_threads, static_cast<double>(storm_handshakes.load()) / seconds, latencies.size(),
+                    failures, percentile(0.50), percentile(0.99), percentile(0.999));
+    }
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::string host = argc > 1 ? argv[1] : "127.0.0.1";
+    std::string port = argc > 2 ? argv[2] : "8443";
+    double seconds = argc > 3 ? std::atof(argv[3]) : 5.0;
+    std::string path = argc > 4 ? argv[4] : "/";
+    std::string version = argc > 5 ? argv[5] : "any";
+    int storm_threads = argc > 6 ? std::atoi(argv[6]) : 0;
+
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: close\r\n\r\n";
+
+    // The examples use self-signed certificates, so the peer is not verified
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT);
+    if (version == "tls1.2")
+    {
+        SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+    }
+    else if (version == "tls1.3")
+    {
+        SSL_CTX_set_min_proto_version(ctx, TLS1_3_VERSION);
+    }
+
+    // The first full handshake prints what was negotiated before the table
+    std::printf("%-8s %10s %12s %10s %8s %9s %9s\n", "mode", "conns", "conns/s", "resumed", "failed",
+                "p50_ms", "p99_ms");
+    run_mode(ctx, host, port, request, seconds, false);
+    run_mode(ctx, host, port, request, seconds, true);
+
+    if (storm_threads > 0)
+    {
+        std::printf("\n%-8s %8s %12s %10s %8s %9s %9s %9s\n", "load", "threads", "storm hs/s", "requests",
+                    "failed", "p50_ms", "p99_ms", "p999_ms");
+        run_request_latency(ctx, host, port, path, seconds, 0);
+        run_request_latency(ctx, host, port, path, seconds, storm_threads);
+    }
+
+    SSL_CTX_free(ctx);
+    return 0;
+}
@@ -1,9 +1,53 @@
 #include "crow.h"
+#include "tls_profile.h"
+#include "tls_session.h"
+#include "tls_reload.h"
+#include "tls_ocsp.h"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
 #include <sstream>
+#include <string>
+#include <vector>
 #include <openssl/ssl.h>
 
-int main()
+// Reads "hostname certificate-chain private-key" lines; a hostname may
+// appear on several lines, one per key type. Blank lines and lines starting
+// with '#' are skipped.
+std::map<std::string, std::vector<tls::CertificateFiles>> read_sni_config(const std::string &path)
 {
+    std::map<std::string, std::vector<tls::CertificateFiles>> hosts;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        std::string host;
+        tls::CertificateFiles files;
+        if (!(fields >> host) || host[0] == '#')
+        {
+            continue;
+        }
+        if (!(fields >> files.certificate_chain >> files.private_key))
+        {
+            throw std::runtime_error(path + ": expected hostname, certificate and key in \"" + line + "\"");
+        }
+        hosts[host].push_back(files);
+    }
+    return hosts;
+}
+
+// Usage: CrowApp [modern|intermediate|legacy]
+int main(int argc, char *argv[])
+{
+    tls::Profile profile = tls::Profile::Intermediate;
+    if (argc > 1 && !tls::parse_profile(argv[1], profile))
+    {
+        std::cerr << "Unknown TLS profile " << argv[1] << ", expected modern, intermediate or legacy" << std::endl;
+        return 1;
+    }
+
     crow::SimpleApp app;
 
     CROW_ROUTE(app, "/")([]()
@@ -21,27 +65,80 @@ int main()
     CROW_ROUTE(app, "/about")([]()
                               { return "This is a Crow C++ web framework example with HTTPS support!"; });
 
-    // configure SSL context to use only TLS 1.2
-    asio::ssl::context ssl_ctx(asio::ssl::context::tlsv12);
+    // Protocol versions, ciphers and groups come from the selected profile.
+    // The RSA certificate is always loaded; with an ECDSA pair next to it,
+    // clients that support ECDSA get the cheaper ECDSA signature.
+    asio::ssl::context ssl_ctx(asio::ssl::context::tls_server);
+    ssl_ctx.set_options(asio::ssl::context::default_workarounds);
+
+    std::vector<tls::CertificateFiles> certificates{{"server.crt", "server.key"}};
+    if (std::ifstream("server-ecdsa.crt") && std::ifstream("server-ecdsa.key"))
+    {
+        certificates.push_back({"server-ecdsa.crt", "server-ecdsa.key"});
+    }
+
+    try
+    {
+        tls::load_certificates(ssl_ctx.native_handle(), certificates);
+        tls::apply_profile(ssl_ctx.native_handle(), profile);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "TLS setup failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "TLS profile: " << tls::profile_name(profile) << ", "
+              << certificates.size() << " certificate(s)" << std::endl;
 
-    ssl_ctx.use_certificate_file("server.crt", asio::ssl::context::pem);
-    ssl_ctx.use_private_key_file("server.key", asio::ssl::context::pem);
+    // Returning clients resume their session instead of a full handshake
+    tls::SessionOptions session_options;
+    session_options.cache_size = 20480;
+    session_options.session_lifetime = std::chrono::minutes(5);
+    session_options.ticket_key_rotation = std::chrono::hours(1);
+    tls::enable_session_resumption(ssl_ctx.native_handle(), session_options);
 
-    // TLS1.2 only configuration
-    SSL_CTX_set_min_proto_version(ssl_ctx.native_handle(), TLS1_2_VERSION);
-    SSL_CTX_set_max_proto_version(ssl_ctx.native_handle(), TLS1_2_VERSION);
+    // Other hostnames, including wildcards like *.example.com, get their
+    // own certificates from sni.conf, selected by the name the client asks
+    // for; server.crt is the "*" entry for everything else. Added after
+    // session resumption is set up, so every context shares its ticket keys.
+    tls::CertificateStore sni_store(ssl_ctx.native_handle());
 
-    // Set cipher suites for TLS 1.2
-    SSL_CTX_set_cipher_list(ssl_ctx.native_handle(), "ECDHE-RSA-AES256-GCM-SHA384:ECDHE-RSA-AES128-GCM-SHA256");
+    // Every certificate context the store activates, reloads included, gets
+    // OCSP responses fetched in the background and stapled from memory.
+    // OCSP_RESPONDER overrides the URL in the certificates, e.g. to test
+    // against a local `openssl ocsp -port` responder.
+    tls::OcspOptions ocsp_options;
+    if (const char *responder = std::getenv("OCSP_RESPONDER"))
+    {
+        ocsp_options.responder_url = responder;
+    }
+    tls::OcspStapler ocsp_stapler(ocsp_options);
+    sni_store.set_listener([&ocsp_stapler](const std::string &pattern, SSL_CTX *ctx)
+                           { ocsp_stapler.attach(pattern, ctx); });
 
-    // Set SSL options
-    ssl_ctx.set_options(
-        asio::ssl::context::default_workarounds |
-        asio::ssl::context::no_sslv2 |
-        asio::ssl::context::no_sslv3 |
-        asio::ssl::context::no_tlsv1 |
-        asio::ssl::context::no_tlsv1_1 |
-        asio::ssl::context::no_tlsv1_3);
+    // Renewed certificate files are validated and swapped in for new
+    // handshakes without a restart
+    tls::CertificateWatcher certificate_watcher(sni_store);
+    try
+    {
+        sni_store.add("*", certificates, tls::Validity::Warn);
+        certificate_watcher.watch("*", certificates);
+        for (const auto &host : read_sni_config("sni.conf"))
+        {
+            sni_store.add(host.first, host.second, tls::Validity::Warn);
+            certificate_watcher.watch(host.first, host.second);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "SNI setup failed: " << e.what() << std::endl;
+        return 1;
+    }
+    sni_store.install();
+    certificate_watcher.start();
+    ocsp_stapler.start();
+    std::cout << "SNI: " << sni_store.size() - 1 << " hostname(s) from sni.conf, reloading certificates on change"
+              << std::endl;
 
     // Start the server with HTTPS enabled on port 8443
     app.port(8443)
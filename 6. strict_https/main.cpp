@@ -1,132 +1,159 @@
 #include <crow.h>
-#include <thread>
+#include "json_template.h"
+#include "tls_session.h"
+#include "tls_reload.h"
+#include "tls_ocsp.h"
+#include "https_redirect.h"
+#include "security_headers.h"
+#include "route_metrics.h"
 #include <string>
 #include <iostream>
-#include <chrono>
+#include <memory>
+#include <vector>
 
-// Helper function to add security headers
-crow::response add_security_headers(crow::response res)
-{
-    res.set_header("Strict-Transport-Security", "max-age=31536000; includeSubDomains; preload");
-    res.set_header("X-Frame-Options", "DENY");
-    res.set_header("X-Content-Type-Options", "nosniff");
-    res.set_header("X-XSS-Protection", "1; mode=block");
-    return res;
-}
+// Pages and the API carry different security header policies; each route
+// group gets its own middleware type
+struct PageRoutes;
+struct ApiRoutes;
+using PageHeaders = security_headers::Middleware<PageRoutes>;
+using ApiHeaders = security_headers::Middleware<ApiRoutes>;
 
 class HTTPSRedirectApp
 {
 public:
-    void run()
+    HTTPSRedirectApp(unsigned short http_port = 8081, unsigned short https_port = 8443)
+        : http_port_(http_port), https_port_(https_port)
+    {
+    }
+
+    // Returns the process exit code: 1 if a port or the TLS setup fails
+    int run()
     {
-        std::thread http_thread([this]()
-                                {
-            crow::SimpleApp http_app;
-
-            // Catch all HTTP requests and redirect to HTTPS
-            CROW_ROUTE(http_app, "/<path>")
-            ([](const crow::request& req, const std::string& path) {
-                crow::response res(301);
-                std::string host = req.get_header_value("Host");
-                if (host.empty()) {
-                    host = "localhost:8443";
-                } else {
-                    // Replace port 8081 with 8443 for testing
-                    size_t port_pos = host.find(":8081");
-                    if (port_pos != std::string::npos) {
-                        host = host.substr(0, port_pos) + ":8443";
-                    } else if (host.find(":") == std::string::npos) {
-                        host += ":8443";
-                    }
-                }
-                res.set_header("Location", "https://" + host + "/" + path);
-                res.set_header("Cache-Control", "no-cache");
-                return res;
-            });
-
-            // Root redirect
-            CROW_ROUTE(http_app, "/")
-            ([](const crow::request& req) {
-                crow::response res(301);
-                std::string host = req.get_header_value("Host");
-                if (host.empty()) {
-                    host = "localhost:8443";
-                } else {
-                    // Replace port 8081 with 8443 for testing
-                    size_t port_pos = host.find(":8081");
-                    if (port_pos != std::string::npos) {
-                        host = host.substr(0, port_pos) + ":8443";
-                    } else if (host.find(":") == std::string::npos) {
-                        host += ":8443";
-                    }
-                }
-                res.set_header("Location", "https://" + host + "/");
-                res.set_header("Cache-Control", "no-cache");
-                return res;
-            });
-
-            std::cout << "HTTP redirect server starting on port 8081...\n";
-            http_app.port(8081).multithreaded().run(); });
-
-        // Give the HTTP server a moment to start
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-
-        // HTTPS server with HSTS
-        crow::SimpleApp https_app;
-
-        // HTTPS routes with security headers
+        // Plain HTTP gets a 301 to the same host and path on the HTTPS port,
+        // from a single asio thread. The port is bound before run() goes on,
+        // so there is no startup race with the HTTPS server.
+        https_redirect::Options redirect_options;
+        redirect_options.http_port = http_port_;
+        redirect_options.https_port = https_port_;
+        redirect_options.extra_headers = "Cache-Control: no-cache\r\n";
+        std::unique_ptr<https_redirect::Redirector> redirector;
+        try
+        {
+            redirector.reset(new https_redirect::Redirector(redirect_options));
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "HTTP redirect server error: " << e.what() << std::endl;
+            return 1;
+        }
+        redirector->start();
+        std::cout << "HTTP redirect server starting on port " << http_port_ << "...\n";
+
+        // HTTPS server with HSTS. The header blocks are built once here and
+        // shared by every response of their route group. Metrics come
+        // first so their latency includes the other middlewares.
+        crow::App<metrics::Middleware, PageHeaders, ApiHeaders> https_app;
+        https_app.get_middleware<metrics::Middleware>()
+            .route("/")
+            .route("/api/status")
+            .route("/security-headers");
+        https_app.get_middleware<PageHeaders>().use(security_headers::html_page());
+        https_app.get_middleware<ApiHeaders>().use(security_headers::api());
+
         CROW_ROUTE(https_app, "/")
-        ([]()
+            .CROW_MIDDLEWARES(https_app, PageHeaders)([]()
          {
-            crow::response res(200, "text/html", 
+            return crow::response(200, "text/html", 
                 "<h1>Welcome to Secure HTTPS Server!</h1>"
                 "<p>This connection is secured with HTTPS and HSTS headers.</p>"
                 "<p>Try accessing this via HTTP at <a href='http://localhost:8081'>http://localhost:8081</a> - you'll be redirected here!</p>"
-                "<p><a href='/api/status'>Check API Status</a> | <a href='/security-headers'>View Security Headers</a></p>");
-            return add_security_headers(std::move(res)); });
+                "<p><a href='/api/status'>Check API Status</a> | <a href='/security-headers'>View Security Headers</a></p>"); });
+
+        // Every field is constant, so the body is serialized once
+        const std::string status_body = fastjson::Template::Builder()
+                                            .field("status", "secure")
+                                            .field("protocol", "https")
+                                            .field("hsts_enabled", true)
+                                            .field("port", https_port_)
+                                            .field("redirect_port", http_port_)
+                                            .build()
+                                            .render();
 
         CROW_ROUTE(https_app, "/api/status")
-        ([]()
-         {
-            crow::json::wvalue response;
-            response["status"] = "secure";
-            response["protocol"] = "https";
-            response["hsts_enabled"] = true;
-            response["port"] = 8443;
-            response["redirect_port"] = 8081;
-            crow::response res(200, "application/json", response.dump());
-            return add_security_headers(std::move(res)); });
+            .CROW_MIDDLEWARES(https_app, ApiHeaders)([&status_body]()
+         { return crow::response(200, "application/json", status_body); });
+
+        // Lists exactly what the middlewares send
+        const std::string headers_body = "Security Headers Information:\n\nPages:\n" +
+                                         https_app.get_middleware<PageHeaders>().block()->text() +
+                                         "\nAPI:\n" + https_app.get_middleware<ApiHeaders>().block()->text() +
+                                         "\nThese headers are automatically added to all HTTPS responses.\n";
 
         CROW_ROUTE(https_app, "/security-headers")
-        ([]()
-         {
-            crow::response res(200, "text/plain", 
-                "Security Headers Information:\n"
-                "- Strict-Transport-Security: max-age=31536000; includeSubDomains; preload\n"
-                "- X-Frame-Options: DENY\n"
-                "- X-Content-Type-Options: nosniff\n"
-                "- X-XSS-Protection: 1; mode=block\n\n"
-                "These headers are automatically added to all HTTPS responses.\n");
-            return add_security_headers(std::move(res)); });
-
-        std::cout << "HTTPS server starting on port 8443 with SSL...\n";
+            .CROW_MIDDLEWARES(https_app, PageHeaders)([&headers_body]()
+         { return crow::response(200, "text/plain", headers_body); });
+
+        std::cout << "HTTPS server starting on port " << https_port_ << " with SSL...\n";
         std::cout << "Using SSL certificates: server.crt and server.key\n";
         std::cout << "\nTesting URLs:\n";
-        std::cout << "- HTTP (will redirect): http://localhost:8081\n";
-        std::cout << "- HTTPS (with HSTS): https://localhost:8443\n";
+        std::cout << "- HTTP (will redirect): http://localhost:" << http_port_ << "\n";
+        std::cout << "- HTTPS (with HSTS): https://localhost:" << https_port_ << "\n";
+
+        // Same setup as ssl_file(), plus session resumption so returning
+        // clients skip the full handshake
+        asio::ssl::context ssl_ctx(asio::ssl::context::sslv23);
 
-        https_app.port(8443)
-            .ssl_file("server.crt", "server.key")
-            .multithreaded()
-            .run();
+        try
+        {
+            ssl_ctx.use_certificate_chain_file("server.crt");
+            ssl_ctx.use_private_key_file("server.key", asio::ssl::context::pem);
+            ssl_ctx.set_options(asio::ssl::context::default_workarounds |
+                                asio::ssl::context::no_sslv2 |
+                                asio::ssl::context::no_sslv3);
+            tls::enable_session_resumption(ssl_ctx.native_handle());
 
-        http_thread.join();
+            // OCSP responses for the certificate are fetched in the background
+            // and stapled into handshakes from memory
+            tls::OcspStapler ocsp_stapler;
+
+            // Renewed server.crt/server.key are validated and swapped in for
+            // new handshakes without a restart; open connections keep the old
+            // certificate. An expired certificate only warns at startup, but
+            // is never swapped in by a reload.
+            const std::vector<tls::CertificateFiles> certificates{{"server.crt", "server.key"}};
+            tls::CertificateStore certificate_store(ssl_ctx.native_handle());
+            certificate_store.set_listener([&ocsp_stapler](const std::string &pattern, SSL_CTX *ctx)
+                                           { ocsp_stapler.attach(pattern, ctx); });
+            certificate_store.add("*", certificates, tls::Validity::Warn);
+            certificate_store.install();
+            tls::CertificateWatcher certificate_watcher(certificate_store);
+            certificate_watcher.watch("*", certificates);
+            certificate_watcher.start();
+            ocsp_stapler.start();
+
+            https_app.port(https_port_)
+                .ssl(std::move(ssl_ctx))
+                .multithreaded()
+                .run();
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "HTTPS server error: " << e.what() << std::endl;
+            redirector->stop();
+            return 1;
+        }
+
+        redirector->stop();
+        return 0;
     }
+
+private:
+    unsigned short http_port_;
+    unsigned short https_port_;
 };
 
 int main()
 {
     HTTPSRedirectApp app;
-    app.run();
-    return 0;
+    return app.run();
 }
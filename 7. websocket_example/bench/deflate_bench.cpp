@@ -0,0 +1,165 @@
+// Websocket compression cost benchmark.
+//
+// Runs representative GPIO messages through DeflateStream the way the
+// senders do and reports, for each payload, what compression costs and what
+// it saves: CPU nanoseconds per message, bytes saved per message, and
+// nanoseconds per byte saved. Each row is measured both without context
+// takeover (one self-contained stream per message, compressed once per
+// broadcast and shared) and with it (one stream per connection, which keeps
+// its window between messages).
+//
+// Payloads are full gpio_state frames taken from a GpioRegistry, in JSON
+// and binary, and gpio_update deltas in the JSON format the registry
+// publishes. Consecutive messages differ the way live ones do: a few pins
+// change and the generation moves, and every message is generated fresh so
+// the takeover window never holds an exact copy. Rows smaller than DeflateOptions::min_size
+// are marked, since the server sends those uncompressed.
+//
+// Usage: deflate_bench [--messages 20000] [--level 6] [--window-bits 15]
+#include "deflate_stream.h"
+#include "gpio_registry.h"
+#include "json_template.h"
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct BenchOptions {
+    std::size_t messages = 20000;
+    int level = Z_DEFAULT_COMPRESSION;
+    int window_bits = 15;
+};
+
+struct Payload {
+    std::string name;
+    std::function<std::string()> next; // a new message on every call
+};
+
+// Full states from a registry whose pins keep changing
+Payload states(BroadcastHub& hub, unsigned pins, GpioEncoding encoding) {
+    auto registry = std::make_shared<GpioRegistry>(
+        hub, std::unique_ptr<GpioBackend>(new SimulatedGpioBackend(pins)), pins);
+    std::mt19937 random(pins);
+    for (unsigned pin = 1; pin <= pins; ++pin) {
+        registry->set(pin, random() % 2 == 0);
+    }
+
+    Payload payload;
+    payload.name = std::string(encoding == GpioEncoding::Json ? "json" : "binary") + " state, " +
+                   std::to_string(pins) + " pins";
+    payload.next = [registry, encoding, pins, random]() mutable {
+        bool value;
+        registry->toggle(1 + static_cast<unsigned>(random() % pins), value);
+        return registry->snapshot_frame(encoding)->payload();
+    };
+    return payload;
+}
+
+// gpio_update frames carrying changed random pins out of pins
+Payload updates(unsigned pins, unsigned changed) {
+    Payload payload;
+    payload.name = "json update, " + std::to_string(changed) + " of " + std::to_string(pins) + " pins";
+    std::uint64_t generation = 1000;
+    std::mt19937 random(changed);
+    payload.next = [pins, changed, generation, random]() mutable {
+        std::string json = "{\"type\":\"gpio_update\",\"generation\":";
+        fastjson::append_value(json, ++generation);
+        json += ",\"pins\":";
+        fastjson::append_value(json, pins);
+        for (unsigned c = 0; c < changed; ++c) {
+            json += ",\"gpio";
+            fastjson::append_value(json, 1 + random() % pins);
+            json += random() % 2 ? "\":true" : "\":false";
+        }
+        json += '}';
+        return json;
+    };
+    return payload;
+}
+
+struct Result {
+    double input = 0;  // average bytes per message
+    double output = 0; // average compressed bytes, with the flag byte
+    double ns = 0;     // average CPU time in deflate
+};
+
+// Generating the messages is not timed; counters.ns covers deflate only
+Result measure(const BenchOptions& options, const Payload& payload, bool context_takeover) {
+    DeflateStream stream(options.window_bits, options.level, context_takeover);
+    DeflateCounters counters;
+    std::size_t input = 0;
+    std::size_t output = 0;
+    std::string out;
+    for (std::size_t i = 0; i < options.messages; ++i) {
+        std::string message = payload.next();
+        out.assign(1, static_cast<char>(DeflatedText));
+        stream.compress(message, out, counters);
+        input += message.size();
+        output += out.size();
+    }
+
+    Result result;
+    result.input = static_cast<double>(input) / options.messages;
+    result.output = static_cast<double>(output) / options.messages;
+    result.ns = static_cast<double>(counters.ns) / counters.calls;
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        const char* value = argv[i + 1];
+        if (flag == "--messages") {
+            options.messages = std::strtoul(value, nullptr, 10);
+        } else if (flag == "--level") {
+            options.level = std::atoi(value);
+        } else if (flag == "--window-bits") {
+            options.window_bits = std::atoi(value);
+        } else {
+            std::fprintf(stderr, "unknown option %s\n", flag.c_str());
+            return 1;
+        }
+    }
+    if (options.messages == 0) {
+        std::fprintf(stderr, "--messages must be positive\n");
+        return 1;
+    }
+
+    // The registries publish into this hub, which has no subscribers
+    BroadcastHub hub;
+    std::vector<Payload> payloads;
+    for (unsigned pins : {8u, 64u, 512u}) {
+        payloads.push_back(states(hub, pins, GpioEncoding::Json));
+        payloads.push_back(states(hub, pins, GpioEncoding::Binary));
+    }
+    payloads.push_back(updates(512, 1));
+    payloads.push_back(updates(512, 16));
+    payloads.push_back(updates(512, 128));
+
+    DeflateOptions defaults;
+    std::printf("%-28s %8s %9s %9s %7s %8s %9s %10s\n",
+                "payload", "bytes", "takeover", "deflated", "saved%", "ns/msg", "saved_B", "ns/saved_B");
+    for (const auto& payload : payloads) {
+        for (bool takeover : {false, true}) {
+            Result result = measure(options, payload, takeover);
+            double saved = result.input - result.output;
+            char per_byte[32] = "-";
+            if (saved > 0) {
+                std::snprintf(per_byte, sizeof(per_byte), "%.2f", result.ns / saved);
+            }
+            std::printf("%-28s %8.0f %9s %9.0f %7.1f %8.0f %9.0f %10s%s\n",
+                        payload.name.c_str(), result.input, takeover ? "yes" : "no", result.output,
+                        100.0 * saved / result.input, result.ns, saved, per_byte,
+                        result.input < defaults.min_size ? "  (sent raw)" : "");
+        }
+    }
+}
@@ -0,0 +1,525 @@
+// Websocket fan-out benchmark.
+//
+// Starts the example server in-process, opens N loopback clients against
+// /ws, then drives it the way dashboards do: chat messages sent to /ws are
+// echoed to every client, and GPIO toggles posted to /gpio/batch come back
+// as gpio_update frames. Reports broadcast latency percentiles, delivered
+// messages per second and process RSS for each N.
+//
+// Usage: ws_fanout_bench [--clients 10,100,1000,10000,50000] [--messages 200]
+//                        [--toggles 50] [--interval-ms 10] [--port 18080]
+//                        [--threads 4]
+//
+// Clients and server share the process, so RSS includes both sides, and
+// 50k clients need about 100k file descriptors (see ulimit -n).
+#include "ws_server.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct BenchOptions {
+    std::vector<std::size_t> clients{10, 100, 1000, 10000, 50000};
+    std::size_t messages = 200;
+    std::size_t toggles = 50;
+    std::chrono::milliseconds interval{10};
+    std::uint16_t port = 18080;
+    std::size_t threads = 4;
+};
+
+const unsigned PIN_COUNT = 8;
+
+std::int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+std::size_t rss_kb() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            return std::strtoul(line.c_str() + 6, nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+void raise_fd_limit() {
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// Loopback connection. Clients are spread over 127.0.0.2, 127.0.0.3, ... as
+// source addresses so 50k of them do not run out of ephemeral ports.
+int connect_loopback(std::uint16_t port, std::size_t index) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    sockaddr_in local{};
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK + 1 + static_cast<std::uint32_t>(index / 20000));
+
+    sockaddr_in remote{};
+    remote.sin_family = AF_INET;
+    remote.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    remote.sin_port = htons(port);
+
+    if (bind(fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) < 0 ||
+        connect(fd, reinterpret_cast<sockaddr*>(&remote), sizeof(remote)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+bool send_all(int fd, const std::string& data) {
+    std::size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        sent += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+// Reads up to the end of the HTTP response head; anything after it is left
+// in rest
+bool read_response_head(int fd, std::string& head, std::string& rest) {
+    char buffer[4096];
+    std::string data;
+    while (true) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            return false;
+        }
+        data.append(buffer, static_cast<std::size_t>(n));
+
+        std::size_t end = data.find("\r\n\r\n");
+        if (end != std::string::npos) {
+            head = data.substr(0, end);
+            rest = data.substr(end + 4);
+            return true;
+        }
+    }
+}
+
+// Client frames must be masked; an all-zero key leaves the payload as is
+std::string masked_text_frame(const std::string& payload) {
+    std::string frame(1, static_cast<char>(0x81));
+    std::uint64_t length = payload.size();
+    if (length < 126) {
+        frame += static_cast<char>(0x80 | length);
+    } else if (length <= 0xffff) {
+        frame += static_cast<char>(0x80 | 126);
+        frame += static_cast<char>(length >> 8);
+        frame += static_cast<char>(length);
+    } else {
+        frame += static_cast<char>(0x80 | 127);
+        for (int i = 0; i < 8; ++i) {
+            frame += static_cast<char>(length >> (56 - 8 * i));
+        }
+    }
+    frame.append(4, '\0');
+    frame += payload;
+    return frame;
+}
+
+int open_websocket(std::uint16_t port, std::size_t index, std::string& rest) {
+    int fd = connect_loopback(port, index);
+    if (fd < 0) {
+        return -1;
+    }
+
+    std::string head;
+    bool upgraded = send_all(fd, "GET /ws HTTP/1.1\r\n"
+                                 "Host: 127.0.0.1\r\n"
+                                 "Upgrade: websocket\r\n"
+                                 "Connection: Upgrade\r\n"
+                                 "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                                 "Sec-WebSocket-Version: 13\r\n\r\n") &&
+                    read_response_head(fd, head, rest) && head.find(" 101 ") != std::string::npos;
+    if (!upgraded) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Toggles one pin through /gpio/batch; returns the generation it produced, or 0
+std::uint64_t post_toggle(std::uint16_t port, unsigned pin) {
+    int fd = connect_loopback(port, 0);
+    if (fd < 0) {
+        return 0;
+    }
+
+    std::string body = "{\"toggle\":[" + std::to_string(pin) + "]}";
+    std::string request = "POST /gpio/batch HTTP/1.1\r\n"
+                          "Host: 127.0.0.1\r\n"
+                          "Content-Type: application/json\r\n"
+                          "Connection: close\r\n"
+                          "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+
+    std::string response;
+    if (send_all(fd, request)) {
+        char buffer[4096];
+        ssize_t n;
+        while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+            response.append(buffer, static_cast<std::size_t>(n));
+        }
+    }
+    close(fd);
+
+    std::size_t at = response.find("\"generation\":");
+    return at == std::string::npos ? 0 : std::strtoull(response.c_str() + at + 13, nullptr, 10);
+}
+
+// One thread's share of the clients, driven by its own epoll loop
+class ClientGroup {
+public:
+    std::vector<std::int64_t> chat_latency_ns;
+    std::vector<std::pair<std::uint64_t, std::int64_t>> gpio_receipts; // generation, receive time
+    std::uint64_t frames = 0;
+    std::int64_t last_receive_ns = 0;
+    std::size_t failed = 0;
+
+    explicit ClientGroup(std::atomic<std::uint64_t>& chat_received) : chat_received_(chat_received) {}
+
+    ~ClientGroup() {
+        for (auto& connection : connections_) {
+            close(connection.fd);
+        }
+        if (epoll_fd_ >= 0) {
+            close(epoll_fd_);
+        }
+    }
+
+    void connect(std::uint16_t port, std::size_t first, std::size_t count) {
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        connections_.reserve(count);
+
+        for (std::size_t i = 0; i < count; ++i) {
+            std::string rest;
+            int fd = open_websocket(port, first + i, rest);
+            if (fd < 0) {
+                ++failed;
+                continue;
+            }
+            connections_.push_back(Connection{fd, std::move(rest)});
+        }
+
+        for (std::size_t i = 0; i < connections_.size(); ++i) {
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.u64 = i;
+            epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, connections_[i].fd, &event);
+        }
+    }
+
+    std::size_t connected() const { return connections_.size(); }
+
+    void run(const std::atomic<bool>& stop) {
+        std::vector<epoll_event> events(256);
+        char buffer[16384];
+
+        while (!stop.load(std::memory_order_relaxed)) {
+            int ready = epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), 100);
+            for (int i = 0; i < ready; ++i) {
+                Connection& connection = connections_[events[i].data.u64];
+                ssize_t n = recv(connection.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+                if (n <= 0) {
+                    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, connection.fd, nullptr);
+                    continue;
+                }
+                connection.in.append(buffer, static_cast<std::size_t>(n));
+                parse_frames(connection);
+            }
+        }
+    }
+
+private:
+    struct Connection {
+        int fd;
+        std::string in;
+    };
+
+    std::atomic<std::uint64_t>& chat_received_;
+    std::vector<Connection> connections_;
+    int epoll_fd_ = -1;
+
+    // Server frames are unmasked and, from Crow, never fragmented
+    void parse_frames(Connection& connection) {
+        const std::string& in = connection.in;
+        std::size_t offset = 0;
+
+        while (in.size() - offset >= 2) {
+            const auto* p = reinterpret_cast<const unsigned char*>(in.data() + offset);
+            std::uint64_t length = p[1] & 0x7f;
+            std::size_t header = 2;
+            if (length == 126) {
+                header = 4;
+            } else if (length == 127) {
+                header = 10;
+            }
+            if (in.size() - offset < header) {
+                break;
+            }
+            if (header == 4) {
+                length = (std::uint64_t(p[2]) << 8) | p[3];
+            } else if (header == 10) {
+                length = 0;
+                for (int i = 0; i < 8; ++i) {
+                    length = (length << 8) | p[2 + i];
+                }
+            }
+            if (in.size() - offset - header < length) {
+                break;
+            }
+
+            if ((p[0] & 0x0f) == 0x1) {
+                on_text(in.data() + offset + header, static_cast<std::size_t>(length));
+            }
+            offset += header + static_cast<std::size_t>(length);
+        }
+        connection.in.erase(0, offset);
+    }
+
+    void on_text(const char* data, std::size_t length) {
+        std::int64_t now = now_ns();
+        ++frames;
+        last_receive_ns = now;
+
+        std::string text(data, length);
+        if (text.compare(0, 6, "bench ") == 0) {
+            // "bench <seq> <send time ns>"
+            const char* sent = std::strchr(text.c_str() + 6, ' ');
+            if (sent != nullptr) {
+                chat_latency_ns.push_back(now - std::strtoll(sent + 1, nullptr, 10));
+                chat_received_.fetch_add(1, std::memory_order_relaxed);
+            }
+            return;
+        }
+
+        std::size_t at = text.find("\"type\":\"gpio_update\"");
+        if (at != std::string::npos && (at = text.find("\"generation\":")) != std::string::npos) {
+            gpio_receipts.emplace_back(std::strtoull(text.c_str() + at + 13, nullptr, 10), now);
+        }
+    }
+};
+
+double percentile_ms(std::vector<std::int64_t>& values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::size_t index = static_cast<std::size_t>(p * static_cast<double>(values.size() - 1));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return static_cast<double>(values[index]) / 1e6;
+}
+
+void run_stage(const BenchOptions& options, std::size_t clients, std::uint16_t port) {
+    WsServerConfig config;
+    config.pin_count = PIN_COUNT;
+    config.template_dir.clear();
+    config.hub.max_queued_messages = 4096;
+    config.hub.max_queued_bytes = 16 << 20;
+    config.hub.heartbeat_interval = std::chrono::seconds(0);
+
+    std::size_t rss_start = rss_kb();
+    auto server = std::make_unique<WsServer>(config);
+    auto& app = server->app();
+    app.loglevel(crow::LogLevel::Warning);
+    auto running = app.port(port).multithreaded().run_async();
+    app.wait_for_server_start();
+
+    // Connect everyone, each group from its own thread
+    std::atomic<std::uint64_t> chat_received{0};
+    std::atomic<bool> stop{false};
+    std::atomic<std::size_t> groups_ready{0};
+    std::size_t thread_count = std::max<std::size_t>(1, std::min(options.threads, clients));
+
+    std::vector<std::unique_ptr<ClientGroup>> groups;
+    std::vector<std::thread> threads;
+    std::int64_t connect_start = now_ns();
+    for (std::size_t t = 0; t < thread_count; ++t) {
+        std::size_t first = clients * t / thread_count;
+        std::size_t count = clients * (t + 1) / thread_count - first;
+        groups.push_back(std::make_unique<ClientGroup>(chat_received));
+        ClientGroup* group = groups.back().get();
+        threads.emplace_back([&, group, first, count] {
+            group->connect(port, first, count);
+            groups_ready.fetch_add(1);
+            group->run(stop);
+        });
+    }
+    while (groups_ready.load() < thread_count) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    std::size_t connected = 0;
+    std::size_t failed = 0;
+    for (const auto& group : groups) {
+        connected += group->connected();
+        failed += group->failed;
+    }
+    for (int i = 0; i < 1000 && server->hub().subscriber_count() < connected; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    double connect_seconds = static_cast<double>(now_ns() - connect_start) / 1e9;
+    std::size_t rss_connected = rss_kb();
+
+    // The driver only sends; it drops its own subscriptions so its unread
+    // socket does not fill up
+    std::string rest;
+    int driver = open_websocket(port, clients, rest);
+    if (driver >= 0) {
+        send_all(driver, masked_text_frame("{\"action\":\"unsubscribe\",\"topics\":[\"gpio\",\"chat\"]}"));
+    }
+
+    std::vector<std::pair<std::uint64_t, std::int64_t>> toggles_sent;
+    std::size_t rounds = std::max(options.messages, options.toggles);
+    std::int64_t drive_start = now_ns();
+    for (std::size_t i = 0; i < rounds && driver >= 0; ++i) {
+        if (i < options.messages) {
+            send_all(driver, masked_text_frame("bench " + std::to_string(i) + " " + std::to_string(now_ns())));
+        }
+        if (i < options.toggles) {
+            std::int64_t sent = now_ns();
+            std::uint64_t generation = post_toggle(port, static_cast<unsigned>(i % PIN_COUNT) + 1);
+            if (generation != 0) {
+                toggles_sent.emplace_back(generation, sent);
+            }
+        }
+        std::this_thread::sleep_for(options.interval);
+    }
+
+    std::uint64_t expected = static_cast<std::uint64_t>(connected) * options.messages;
+    for (int i = 0; i < 1000 && chat_received.load() < expected; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    // Let the last GPIO tick go out
+    std::this_thread::sleep_for(config.gpio_tick * 2);
+
+    stop = true;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::vector<std::int64_t> chat;
+    std::vector<std::int64_t> gpio;
+    std::uint64_t frames = 0;
+    std::int64_t drive_end = drive_start;
+    std::sort(toggles_sent.begin(), toggles_sent.end());
+    for (const auto& group : groups) {
+        chat.insert(chat.end(), group->chat_latency_ns.begin(), group->chat_latency_ns.end());
+        frames += group->frames;
+        drive_end = std::max(drive_end, group->last_receive_ns);
+
+        // Updates are coalesced per tick, so only generations that match a
+        // toggle exactly can be timed
+        for (const auto& receipt : group->gpio_receipts) {
+            auto it = std::lower_bound(toggles_sent.begin(), toggles_sent.end(),
+                                       std::make_pair(receipt.first, std::int64_t(0)));
+            if (it != toggles_sent.end() && it->first == receipt.first) {
+                gpio.push_back(receipt.second - it->second);
+            }
+        }
+    }
+
+    double drive_seconds = static_cast<double>(drive_end - drive_start) / 1e9;
+    HubStats stats = server->hub().stats();
+    std::printf("%8zu %6zu %9.2f %9.1f %8.1f %11.0f %8.2f %8.2f %8.2f %8.2f %8.2f %8lu\n",
+                clients, failed, connect_seconds,
+                static_cast<double>(rss_connected) / 1024.0,
+                connected ? static_cast<double>(rss_connected - std::min(rss_connected, rss_start)) / connected : 0.0,
+                drive_seconds > 0 ? static_cast<double>(frames) / drive_seconds : 0.0,
+                percentile_ms(chat, 0.50), percentile_ms(chat, 0.99), percentile_ms(chat, 0.999),
+                percentile_ms(gpio, 0.50), percentile_ms(gpio, 0.99),
+                static_cast<unsigned long>(stats.frames_dropped));
+    std::fflush(stdout);
+
+    if (driver >= 0) {
+        close(driver);
+    }
+    groups.clear();
+    app.stop();
+    running.get();
+}
+
+std::vector<std::size_t> parse_list(const char* text) {
+    std::vector<std::size_t> values;
+    for (const char* p = text; *p != '\0';) {
+        char* end;
+        values.push_back(std::strtoul(p, &end, 10));
+        p = *end == ',' ? end + 1 : end;
+        if (end == p && *p != '\0') {
+            break;
+        }
+    }
+    return values;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        const char* value = argv[i + 1];
+        if (flag == "--clients") {
+            options.clients = parse_list(value);
+        } else if (flag == "--messages") {
+            options.messages = std::strtoul(value, nullptr, 10);
+        } else if (flag == "--toggles") {
+            options.toggles = std::strtoul(value, nullptr, 10);
+        } else if (flag == "--interval-ms") {
+            options.interval = std::chrono::milliseconds(std::strtoul(value, nullptr, 10));
+        } else if (flag == "--port") {
+            options.port = static_cast<std::uint16_t>(std::strtoul(value, nullptr, 10));
+        } else if (flag == "--threads") {
+            options.threads = std::strtoul(value, nullptr, 10);
+        } else {
+            std::fprintf(stderr, "unknown option %s\n", flag.c_str());
+            return 1;
+        }
+    }
+
+    raise_fd_limit();
+
+    // GPIO latency includes waiting for the registry's 50 ms publish tick
+    std::printf("%8s %6s %9s %9s %8s %11s %8s %8s %8s %8s %8s %8s\n",
+                "clients", "failed", "connect_s", "rss_MB", "KB/conn", "msgs/s",
+                "chat_p50", "chat_p99", "p99.9", "gpio_p50", "gpio_p99", "dropped");
+
+    // Each stage gets its own port so sockets in TIME_WAIT never get in the way
+    for (std::size_t stage = 0; stage < options.clients.size(); ++stage) {
+        run_stage(options, options.clients[stage], static_cast<std::uint16_t>(options.port + stage));
+    }
+}
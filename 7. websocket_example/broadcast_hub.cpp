@@ -0,0 +1,549 @@
+#include "broadcast_hub.h"
+#include <algorithm>
+
+namespace {
+
+const std::chrono::seconds WHEEL_TICK(1);
+
+std::int64_t steady_now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+} // namespace
+
+BroadcastHub::BroadcastHub(HubOptions options)
+    : options_(options), snapshot_(std::make_shared<const SubscriberList>()) {
+    if (options_.max_queued_messages == 0) {
+        options_.max_queued_messages = 1;
+    }
+    if (options_.sender_threads == 0) {
+        options_.sender_threads = 1;
+    }
+    options_.deflate.window_bits = std::min(15, std::max(9, options_.deflate.window_bits));
+
+    for (std::size_t i = 0; i < options_.sender_threads; ++i) {
+        senders_.emplace_back([this] { sender_loop(); });
+    }
+
+    if (options_.heartbeat_interval.count() > 0 && options_.idle_timeout.count() > 0) {
+        wheel_.resize(static_cast<std::size_t>(options_.heartbeat_interval / WHEEL_TICK));
+        heartbeat_ = std::thread([this] { heartbeat_loop(); });
+    }
+}
+
+BroadcastHub::~BroadcastHub() {
+    if (heartbeat_.joinable()) {
+        {
+            std::lock_guard<std::mutex> _(wheel_mutex_);
+            wheel_stopping_ = true;
+        }
+        wheel_cv_.notify_all();
+        heartbeat_.join();
+    }
+
+    {
+        std::lock_guard<std::mutex> _(ready_mutex_);
+        stopping_ = true;
+    }
+    ready_cv_.notify_all();
+    for (auto& sender : senders_) {
+        sender.join();
+    }
+}
+
+std::shared_ptr<Subscriber> BroadcastHub::add(crow::websocket::connection& conn, DeflateParams deflate) {
+    auto subscriber = std::make_shared<Subscriber>(conn, deflate);
+    if (deflate.enabled && (deflate.context_takeover || deflate.window_bits < options_.deflate.window_bits)) {
+        subscriber->deflater_ = std::make_unique<DeflateStream>(deflate.window_bits, options_.deflate.level,
+                                                                deflate.context_takeover);
+    }
+
+    subscriber->last_seen_ms_.store(steady_now_ms(), std::memory_order_relaxed);
+    conn.userdata(subscriber.get());
+
+    {
+        std::lock_guard<std::mutex> _(registry_mutex_);
+        by_connection_[&conn] = subscriber;
+        publish_snapshot();
+    }
+
+    if (!wheel_.empty()) {
+        // The slot just behind the cursor comes round a full interval from now
+        std::lock_guard<std::mutex> _(wheel_mutex_);
+        wheel_[(wheel_cursor_ + wheel_.size() - 1) % wheel_.size()].push_back(subscriber);
+    }
+    return subscriber;
+}
+
+bool BroadcastHub::remove(crow::websocket::connection& conn) {
+    std::shared_ptr<Subscriber> subscriber;
+    {
+        std::lock_guard<std::mutex> _(registry_mutex_);
+        auto it = by_connection_.find(&conn);
+        if (it == by_connection_.end()) {
+            return false;
+        }
+        subscriber = it->second;
+        by_connection_.erase(it);
+        publish_snapshot();
+        conn.userdata(nullptr);
+
+        std::unique_lock<std::shared_mutex> topics_lock(topics_mutex_);
+        for (const auto& topic : subscriber->topics_) {
+            remove_from_topic(topic, subscriber.get());
+        }
+        subscriber->topics_.clear();
+    }
+
+    // Waits for an in-flight send to this connection to finish; afterwards
+    // no sender will touch it again. The heartbeat wheel drops it lazily.
+    std::lock_guard<std::mutex> _(subscriber->mutex_);
+    subscriber->conn_ = nullptr;
+    clear_locked(*subscriber);
+    return true;
+}
+
+void BroadcastHub::touch(crow::websocket::connection& conn) {
+    // onmessage and onclose run on the connection's own io thread, so the
+    // subscriber cannot be removed underneath us
+    if (auto* subscriber = static_cast<Subscriber*>(conn.userdata())) {
+        subscriber->last_seen_ms_.store(steady_now_ms(), std::memory_order_relaxed);
+    }
+}
+
+void BroadcastHub::broadcast(std::string payload, bool binary) {
+    broadcast(binary ? SharedFrame::binary(std::move(payload)) : SharedFrame::text(std::move(payload)));
+}
+
+void BroadcastHub::broadcast(const SharedFramePtr& frame) {
+    frames_published_.fetch_add(1, std::memory_order_relaxed);
+
+    auto subscribers = std::atomic_load(&snapshot_);
+    for (const auto& subscriber : *subscribers) {
+        enqueue(subscriber, frame);
+    }
+}
+
+void BroadcastHub::send(const std::shared_ptr<Subscriber>& subscriber, const SharedFramePtr& frame) {
+    enqueue(subscriber, frame);
+}
+
+bool BroadcastHub::subscribe(crow::websocket::connection& conn, const std::string& topic) {
+    std::lock_guard<std::mutex> _(registry_mutex_);
+    auto it = by_connection_.find(&conn);
+    if (it == by_connection_.end() || it->second->abandoned_) {
+        return false;
+    }
+    const auto& subscriber = it->second;
+
+    std::unique_lock<std::shared_mutex> topics_lock(topics_mutex_);
+    auto& topics = subscriber->topics_;
+    for (const auto& existing : topics) {
+        if (existing == topic) {
+            return true;
+        }
+    }
+    if (topics.size() >= options_.max_topics_per_subscriber) {
+        return false;
+    }
+    topics.push_back(topic);
+
+    auto& list = topics_[topic];
+    auto updated = list ? std::make_shared<SubscriberList>(*list) : std::make_shared<SubscriberList>();
+    updated->push_back(subscriber);
+    list = std::move(updated);
+    return true;
+}
+
+bool BroadcastHub::unsubscribe(crow::websocket::connection& conn, const std::string& topic) {
+    std::lock_guard<std::mutex> _(registry_mutex_);
+    auto it = by_connection_.find(&conn);
+    if (it == by_connection_.end()) {
+        return false;
+    }
+    const auto& subscriber = it->second;
+
+    std::unique_lock<std::shared_mutex> topics_lock(topics_mutex_);
+    auto& topics = subscriber->topics_;
+    for (auto t = topics.begin(); t != topics.end(); ++t) {
+        if (*t == topic) {
+            topics.erase(t);
+            remove_from_topic(topic, subscriber.get());
+            return true;
+        }
+    }
+    return false;
+}
+
+void BroadcastHub::publish(const std::string& topic, const SharedFramePtr& frame) {
+    std::shared_ptr<const SubscriberList> subscribers;
+    {
+        std::shared_lock<std::shared_mutex> _(topics_mutex_);
+        auto it = topics_.find(topic);
+        if (it == topics_.end()) {
+            return;
+        }
+        subscribers = it->second;
+    }
+
+    frames_published_.fetch_add(1, std::memory_order_relaxed);
+    for (const auto& subscriber : *subscribers) {
+        enqueue(subscriber, frame);
+    }
+}
+
+bool BroadcastHub::has_subscribers(const std::string& topic) const {
+    std::shared_lock<std::shared_mutex> _(topics_mutex_);
+    return topics_.find(topic) != topics_.end();
+}
+
+std::size_t BroadcastHub::subscriber_count() const {
+    return std::atomic_load(&snapshot_)->size();
+}
+
+HubStats BroadcastHub::stats() const {
+    return HubStats{frames_published_.load(std::memory_order_relaxed),
+                    frames_sent_.load(std::memory_order_relaxed),
+                    wire_bytes_sent_.load(std::memory_order_relaxed),
+                    frames_dropped_.load(std::memory_order_relaxed),
+                    resyncs_.load(std::memory_order_relaxed),
+                    payload_bytes_sent_.load(std::memory_order_relaxed),
+                    frames_compressed_.load(std::memory_order_relaxed),
+                    deflate_calls_.load(std::memory_order_relaxed),
+                    deflate_ns_.load(std::memory_order_relaxed),
+                    queued_bytes_.load(std::memory_order_relaxed),
+                    pings_sent_.load(std::memory_order_relaxed),
+                    idle_evictions_.load(std::memory_order_relaxed),
+                    slow_consumer_evictions_.load(std::memory_order_relaxed),
+                    close_timeouts_.load(std::memory_order_relaxed)};
+}
+
+void BroadcastHub::publish_snapshot() {
+    auto list = std::make_shared<SubscriberList>();
+    list->reserve(by_connection_.size());
+    for (const auto& entry : by_connection_) {
+        if (!entry.second->abandoned_) {
+            list->push_back(entry.second);
+        }
+    }
+    std::atomic_store(&snapshot_, std::shared_ptr<const SubscriberList>(std::move(list)));
+}
+
+void BroadcastHub::remove_from_topic(const std::string& topic, const Subscriber* subscriber) {
+    auto it = topics_.find(topic);
+    if (it == topics_.end()) {
+        return;
+    }
+
+    auto updated = std::make_shared<SubscriberList>();
+    updated->reserve(it->second->size());
+    for (const auto& entry : *it->second) {
+        if (entry.get() != subscriber) {
+            updated->push_back(entry);
+        }
+    }
+
+    if (updated->empty()) {
+        topics_.erase(it);
+    } else {
+        it->second = std::move(updated);
+    }
+}
+
+void BroadcastHub::enqueue(const std::shared_ptr<Subscriber>& subscriber, const SharedFramePtr& frame) {
+    {
+        std::lock_guard<std::mutex> _(subscriber->mutex_);
+        if (subscriber->conn_ == nullptr || subscriber->closing_) {
+            return;
+        }
+
+        // A single frame larger than the byte limit still goes through alone
+        std::size_t size = frame->payload().size();
+        auto fits = [&] {
+            return subscriber->queue_.empty() ||
+                   (subscriber->queue_.size() < options_.max_queued_messages &&
+                    subscriber->queued_bytes_ + size <= options_.max_queued_bytes);
+        };
+
+        if (!fits()) {
+            switch (options_.policy) {
+            case SlowConsumerPolicy::Drop:
+                drop_locked(*subscriber, *frame);
+                if (subscriber->resync_.empty() || subscriber->scheduled_) {
+                    return;
+                }
+                break;
+            case SlowConsumerPolicy::Coalesce:
+                while (!fits()) {
+                    drop_locked(*subscriber, *pop_locked(*subscriber));
+                }
+                push_locked(*subscriber, frame);
+                break;
+            case SlowConsumerPolicy::Disconnect:
+                subscriber->dropped_.fetch_add(1, std::memory_order_relaxed);
+                frames_dropped_.fetch_add(1, std::memory_order_relaxed);
+                if (!close_locked(*subscriber, "slow consumer")) {
+                    return;
+                }
+                slow_consumer_evictions_.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+        } else {
+            push_locked(*subscriber, frame);
+        }
+
+        if (subscriber->scheduled_) {
+            return;
+        }
+        subscriber->scheduled_ = true;
+    }
+    schedule(subscriber);
+}
+
+void BroadcastHub::schedule(const std::shared_ptr<Subscriber>& subscriber) {
+    {
+        std::lock_guard<std::mutex> _(ready_mutex_);
+        ready_.push_back(subscriber);
+    }
+    ready_cv_.notify_one();
+}
+
+void BroadcastHub::push_locked(Subscriber& subscriber, const SharedFramePtr& frame) {
+    subscriber.queue_.push_back(frame);
+    subscriber.queued_bytes_ += frame->payload().size();
+    queued_bytes_.fetch_add(frame->payload().size(), std::memory_order_relaxed);
+}
+
+SharedFramePtr BroadcastHub::pop_locked(Subscriber& subscriber) {
+    SharedFramePtr frame = std::move(subscriber.queue_.front());
+    subscriber.queue_.pop_front();
+    subscriber.queued_bytes_ -= frame->payload().size();
+    queued_bytes_.fetch_sub(frame->payload().size(), std::memory_order_relaxed);
+    return frame;
+}
+
+void BroadcastHub::clear_locked(Subscriber& subscriber) {
+    queued_bytes_.fetch_sub(subscriber.queued_bytes_, std::memory_order_relaxed);
+    subscriber.queue_.clear();
+    subscriber.queued_bytes_ = 0;
+    subscriber.resync_.clear();
+}
+
+void BroadcastHub::drop_locked(Subscriber& subscriber, const SharedFrame& frame) {
+    subscriber.dropped_.fetch_add(1, std::memory_order_relaxed);
+    frames_dropped_.fetch_add(1, std::memory_order_relaxed);
+
+    const SnapshotSourcePtr& source = frame.resync();
+    if (source && std::find(subscriber.resync_.begin(), subscriber.resync_.end(), source) == subscriber.resync_.end()) {
+        subscriber.resync_.push_back(source);
+    }
+}
+
+void BroadcastHub::resync_locked(Subscriber& subscriber, Delivery& totals) {
+    std::vector<SnapshotSourcePtr> sources;
+    sources.swap(subscriber.resync_);
+
+    // Queued deltas from the same sources are older than the snapshot
+    std::deque<SharedFramePtr> kept;
+    while (!subscriber.queue_.empty()) {
+        SharedFramePtr frame = pop_locked(subscriber);
+        const SnapshotSourcePtr& source = frame->resync();
+        if (!source || std::find(sources.begin(), sources.end(), source) == sources.end()) {
+            kept.push_back(std::move(frame));
+        }
+    }
+    for (const auto& frame : kept) {
+        push_locked(subscriber, frame);
+    }
+
+    for (const auto& source : sources) {
+        if (SharedFramePtr snapshot = (*source)()) {
+            deliver(subscriber, *snapshot, totals);
+            resyncs_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+bool BroadcastHub::close_locked(Subscriber& subscriber, const char* reason) {
+    if (subscriber.conn_ == nullptr || subscriber.closing_) {
+        return false;
+    }
+
+    // Leave the close to a sender thread: closing from an io thread can run
+    // the close handler inline while we hold the subscriber's mutex
+    subscriber.closing_ = true;
+    subscriber.close_reason_ = reason;
+    subscriber.close_deadline_ms_ = steady_now_ms() + std::chrono::milliseconds(options_.heartbeat_interval).count();
+    clear_locked(subscriber);
+    return true;
+}
+
+bool BroadcastHub::check_liveness(const std::shared_ptr<Subscriber>& subscriber, std::int64_t now_ms,
+                                  const SharedFramePtr& ping) {
+    std::int64_t idle_ms = now_ms - subscriber->last_seen_ms_.load(std::memory_order_relaxed);
+
+    bool closing;
+    {
+        std::lock_guard<std::mutex> _(subscriber->mutex_);
+        if (subscriber->conn_ == nullptr) {
+            return false;
+        }
+        // Closes normally finish within a round trip; one still pending a
+        // full turn later has a peer that will never answer
+        closing = subscriber->closing_;
+        if (closing && now_ms < subscriber->close_deadline_ms_) {
+            return true;
+        }
+    }
+    if (closing) {
+        abandon(subscriber);
+        return false;
+    }
+
+    if (idle_ms >= std::chrono::milliseconds(options_.idle_timeout).count()) {
+        {
+            std::lock_guard<std::mutex> _(subscriber->mutex_);
+            if (!close_locked(*subscriber, "idle timeout")) {
+                return true;
+            }
+            idle_evictions_.fetch_add(1, std::memory_order_relaxed);
+            if (subscriber->scheduled_) {
+                return true;
+            }
+            subscriber->scheduled_ = true;
+        }
+        schedule(subscriber);
+        return true;
+    }
+
+    if (idle_ms >= std::chrono::milliseconds(options_.heartbeat_interval).count()) {
+        pings_sent_.fetch_add(1, std::memory_order_relaxed);
+        enqueue(subscriber, ping);
+    }
+    return true;
+}
+
+void BroadcastHub::abandon(const std::shared_ptr<Subscriber>& subscriber) {
+    {
+        // Stays in by_connection_, so the userdata of the connection remains
+        // valid for touch() and remove() still finds it from onclose
+        std::lock_guard<std::mutex> _(registry_mutex_);
+        subscriber->abandoned_ = true;
+        publish_snapshot();
+
+        std::unique_lock<std::shared_mutex> topics_lock(topics_mutex_);
+        for (const auto& topic : subscriber->topics_) {
+            remove_from_topic(topic, subscriber.get());
+        }
+        subscriber->topics_.clear();
+    }
+
+    std::lock_guard<std::mutex> _(subscriber->mutex_);
+    if (subscriber->conn_ == nullptr) {
+        return; // onclose got there first
+    }
+    clear_locked(*subscriber);
+    subscriber->deflater_.reset();
+    close_timeouts_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void BroadcastHub::heartbeat_loop() {
+    const SharedFramePtr ping = SharedFrame::text("{\"type\":\"ping\"}");
+
+    std::unique_lock<std::mutex> lock(wheel_mutex_);
+    while (!wheel_cv_.wait_for(lock, WHEEL_TICK, [this] { return wheel_stopping_; })) {
+        std::size_t index = wheel_cursor_;
+        wheel_cursor_ = (wheel_cursor_ + 1) % wheel_.size();
+
+        std::vector<std::shared_ptr<Subscriber>> due;
+        due.swap(wheel_[index]);
+        lock.unlock();
+
+        // Survivors go back in the same slot, one full turn from now
+        std::int64_t now_ms = steady_now_ms();
+        auto alive = std::remove_if(due.begin(), due.end(), [&](const std::shared_ptr<Subscriber>& subscriber) {
+            return !check_liveness(subscriber, now_ms, ping);
+        });
+        due.erase(alive, due.end());
+
+        lock.lock();
+        auto& slot = wheel_[index];
+        slot.insert(slot.end(), std::make_move_iterator(due.begin()), std::make_move_iterator(due.end()));
+    }
+}
+
+void BroadcastHub::deliver(Subscriber& subscriber, const SharedFrame& frame, Delivery& totals) {
+    const std::string& payload = frame.payload();
+    totals.frames += 1;
+    totals.payload_bytes += payload.size();
+
+    if (!subscriber.deflate_.enabled || (!frame.is_binary() && payload.size() < options_.deflate.min_size)) {
+        frame.send_to(*subscriber.conn_);
+        totals.wire_bytes += frame.wire_size();
+        return;
+    }
+
+    std::string message;
+    if (payload.size() < options_.deflate.min_size) {
+        // Too small to be worth compressing, but binary messages still
+        // carry the flag byte for this client
+        message.reserve(payload.size() + 1);
+        message.push_back(static_cast<char>(RawBinary));
+        message += payload;
+    } else if (subscriber.deflater_) {
+        message.push_back(static_cast<char>(frame.is_binary() ? DeflatedBinary : DeflatedText));
+        subscriber.deflater_->compress(payload, message, totals.deflate);
+        totals.compressed += 1;
+    } else {
+        message = frame.deflated(options_.deflate, totals.deflate);
+        totals.compressed += 1;
+    }
+
+    totals.wire_bytes += SharedFrame::header_size_for(message.size()) + message.size();
+    subscriber.conn_->send_binary(std::move(message));
+}
+
+void BroadcastHub::sender_loop() {
+    while (true) {
+        std::shared_ptr<Subscriber> subscriber;
+        {
+            std::unique_lock<std::mutex> lock(ready_mutex_);
+            ready_cv_.wait(lock, [this] { return stopping_ || !ready_.empty(); });
+            if (stopping_) {
+                return;
+            }
+            subscriber = std::move(ready_.front());
+            ready_.pop_front();
+        }
+
+        // Crow queues the write on the connection's io thread and returns, so
+        // the lock is only held for the hand-off, never for the network write
+        std::lock_guard<std::mutex> _(subscriber->mutex_);
+        subscriber->scheduled_ = false;
+        if (subscriber->conn_ == nullptr) {
+            continue;
+        }
+
+        if (subscriber->closing_) {
+            subscriber->conn_->close(subscriber->close_reason_, crow::websocket::CloseStatusCode::PolicyViolated);
+            continue;
+        }
+
+        Delivery totals;
+        if (!subscriber->resync_.empty()) {
+            resync_locked(*subscriber, totals);
+        }
+        while (!subscriber->queue_.empty()) {
+            SharedFramePtr frame = pop_locked(*subscriber);
+            deliver(*subscriber, *frame, totals);
+        }
+        frames_sent_.fetch_add(totals.frames, std::memory_order_relaxed);
+        wire_bytes_sent_.fetch_add(totals.wire_bytes, std::memory_order_relaxed);
+        payload_bytes_sent_.fetch_add(totals.payload_bytes, std::memory_order_relaxed);
+        frames_compressed_.fetch_add(totals.compressed, std::memory_order_relaxed);
+        deflate_calls_.fetch_add(totals.deflate.calls, std::memory_order_relaxed);
+        deflate_ns_.fetch_add(totals.deflate.ns, std::memory_order_relaxed);
+    }
+}
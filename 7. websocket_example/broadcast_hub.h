@@ -0,0 +1,237 @@
+#pragma once
+
+#include "crow.h"
+#include "deflate_stream.h"
+#include "shared_frame.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// What to do when a connection's send queue is full
+//
+// A dropped frame that carries a snapshot source (a state delta) is not
+// simply lost: the connection is marked, and its next delivery starts with
+// a fresh snapshot in place of the deltas still queued from that source.
+enum class SlowConsumerPolicy {
+    Drop,       // discard the new message
+    Coalesce,   // discard the oldest queued messages, newest state wins
+    Disconnect  // close the connection
+};
+
+struct HubOptions {
+    std::size_t max_queued_messages = 64;
+    std::size_t max_queued_bytes = 1 << 20; // per connection, payload bytes
+    SlowConsumerPolicy policy = SlowConsumerPolicy::Coalesce;
+    std::size_t sender_threads = 2;
+    std::size_t max_topics_per_subscriber = 64;
+    DeflateOptions deflate;
+
+    // Connections silent for heartbeat_interval are sent {"type":"ping"};
+    // any message from the client, such as {"type":"pong"}, counts as alive.
+    // Connections silent for idle_timeout are closed, and dropped from the
+    // hub if the close is still unfinished one heartbeat_interval later.
+    // Zero disables all of it.
+    std::chrono::seconds heartbeat_interval{15};
+    std::chrono::seconds idle_timeout{45};
+};
+
+struct HubStats {
+    std::uint64_t frames_published; // frames built once and fanned out
+    std::uint64_t frames_sent;      // per-recipient deliveries
+    std::uint64_t wire_bytes_sent;  // header + payload bytes handed to connections
+    std::uint64_t frames_dropped;
+    std::uint64_t resyncs;            // snapshots sent to replace dropped deltas
+    std::uint64_t payload_bytes_sent; // payload bytes before compression
+    std::uint64_t frames_compressed;  // deliveries sent deflated
+    std::uint64_t deflate_calls;      // deflate runs, shared frames count once
+    std::uint64_t deflate_ns;         // CPU time spent in deflate
+    std::uint64_t queued_bytes;       // payload bytes waiting in send queues now
+    std::uint64_t pings_sent;
+    std::uint64_t idle_evictions;
+    std::uint64_t slow_consumer_evictions;
+    std::uint64_t close_timeouts; // closes the peer never completed
+};
+
+// Per-connection state. The connection pointer is cleared under the
+// subscriber's own mutex when the socket closes, so senders never touch a
+// destroyed connection and never need the hub-wide lock.
+class Subscriber {
+public:
+    Subscriber(crow::websocket::connection& conn, DeflateParams deflate) : conn_(&conn), deflate_(deflate) {}
+
+    std::uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    friend class BroadcastHub;
+
+    std::mutex mutex_;
+    crow::websocket::connection* conn_;
+    std::deque<SharedFramePtr> queue_;
+    std::size_t queued_bytes_ = 0;
+    bool scheduled_ = false;
+    bool closing_ = false;
+    const char* close_reason_ = nullptr;
+    std::int64_t close_deadline_ms_ = 0;
+    bool abandoned_ = false; // guarded by the hub's registry_mutex_
+    std::atomic<std::uint64_t> dropped_{0};
+
+    // Sources of dropped deltas; the next delivery sends their snapshots
+    std::vector<SnapshotSourcePtr> resync_;
+
+    // Steady clock, milliseconds; written by the connection's io thread
+    std::atomic<std::int64_t> last_seen_ms_{0};
+
+    // Only set when this connection cannot share broadcast compression:
+    // context takeover or a smaller window than the server's
+    DeflateParams deflate_;
+    std::unique_ptr<DeflateStream> deflater_;
+
+    std::vector<std::string> topics_; // guarded by the hub's topics_mutex_
+};
+
+// Fan-out of websocket messages.
+//
+// Publishers take a copy-on-write snapshot of the subscriber list and push a
+// shared, already serialized message into each subscriber's bounded queue.
+// Sender threads drain the queues, so neither publishers nor onopen/onclose
+// ever wait on a send. Queues are bounded both in messages and in bytes.
+//
+// Liveness is checked by one heartbeat thread driving a timer wheel with one
+// slot per second of the heartbeat interval. Each connection sits in one slot
+// and is looked at once per turn of the wheel, so the cost per tick is the
+// slot's share of connections and there are no per-connection timers.
+// Half-open connections stop answering pings and are closed after
+// idle_timeout instead of being broadcast to forever.
+//
+// A half-open peer never answers the close frame either, and Crow keeps the
+// connection until it does or TCP gives up on the socket, which can take
+// many minutes. Crow offers no way to abort a connection from outside, so a
+// connection still closing when the wheel comes round again is abandoned:
+// it leaves the subscriber list and its topics and its queue and compressor
+// are freed, and only the small Subscriber stays until onclose calls
+// remove().
+//
+// Besides broadcast() to every connection, messages can be published to a
+// topic. Each topic keeps its own copy-on-write subscriber list, so a publish
+// only walks the connections that asked for it.
+class BroadcastHub {
+public:
+    explicit BroadcastHub(HubOptions options = HubOptions());
+    ~BroadcastHub();
+
+    BroadcastHub(const BroadcastHub&) = delete;
+    BroadcastHub& operator=(const BroadcastHub&) = delete;
+
+    // Takes over conn.userdata() until remove()
+    std::shared_ptr<Subscriber> add(crow::websocket::connection& conn, DeflateParams deflate = DeflateParams());
+    // False if the connection was never added or is already removed
+    bool remove(crow::websocket::connection& conn);
+
+    // Records that the client was heard from; call from onmessage
+    void touch(crow::websocket::connection& conn);
+
+    // Frame once, deliver to every subscriber
+    void broadcast(std::string payload, bool binary = false);
+    void broadcast(const SharedFramePtr& frame);
+
+    // Deliver to a single subscriber (e.g. initial state for a new client)
+    void send(const std::shared_ptr<Subscriber>& subscriber, const SharedFramePtr& frame);
+
+    // Topic subscriptions; subscribe fails for unknown connections or when
+    // the connection already has max_topics_per_subscriber topics
+    bool subscribe(crow::websocket::connection& conn, const std::string& topic);
+    bool unsubscribe(crow::websocket::connection& conn, const std::string& topic);
+
+    // Frame once, deliver to the topic's subscribers
+    void publish(const std::string& topic, const SharedFramePtr& frame);
+
+    // Lets publishers skip building frames nobody will receive
+    bool has_subscribers(const std::string& topic) const;
+
+    std::size_t subscriber_count() const;
+    HubStats stats() const;
+
+private:
+    using SubscriberList = std::vector<std::shared_ptr<Subscriber>>;
+
+    HubOptions options_;
+
+    // Registry: writers serialize on registry_mutex_, readers load the snapshot
+    std::mutex registry_mutex_;
+    std::unordered_map<crow::websocket::connection*, std::shared_ptr<Subscriber>> by_connection_;
+    std::shared_ptr<const SubscriberList> snapshot_;
+
+    // Topic index. Lock order: registry_mutex_, then topics_mutex_.
+    mutable std::shared_mutex topics_mutex_;
+    std::unordered_map<std::string, std::shared_ptr<const SubscriberList>> topics_;
+
+    // Subscribers with queued messages, waiting for a sender thread
+    std::mutex ready_mutex_;
+    std::condition_variable ready_cv_;
+    std::deque<std::shared_ptr<Subscriber>> ready_;
+    bool stopping_ = false;
+    std::vector<std::thread> senders_;
+
+    // Heartbeat timer wheel
+    std::mutex wheel_mutex_;
+    std::condition_variable wheel_cv_;
+    std::vector<std::vector<std::shared_ptr<Subscriber>>> wheel_;
+    std::size_t wheel_cursor_ = 0;
+    bool wheel_stopping_ = false;
+    std::thread heartbeat_;
+
+    std::atomic<std::uint64_t> frames_published_{0};
+    std::atomic<std::uint64_t> frames_sent_{0};
+    std::atomic<std::uint64_t> wire_bytes_sent_{0};
+    std::atomic<std::uint64_t> frames_dropped_{0};
+    std::atomic<std::uint64_t> resyncs_{0};
+    std::atomic<std::uint64_t> payload_bytes_sent_{0};
+    std::atomic<std::uint64_t> frames_compressed_{0};
+    std::atomic<std::uint64_t> deflate_calls_{0};
+    std::atomic<std::uint64_t> deflate_ns_{0};
+    std::atomic<std::uint64_t> queued_bytes_{0};
+    std::atomic<std::uint64_t> pings_sent_{0};
+    std::atomic<std::uint64_t> idle_evictions_{0};
+    std::atomic<std::uint64_t> slow_consumer_evictions_{0};
+    std::atomic<std::uint64_t> close_timeouts_{0};
+
+    // Per-batch totals, folded into the atomics once per drained queue
+    struct Delivery {
+        std::uint64_t frames = 0;
+        std::uint64_t wire_bytes = 0;
+        std::uint64_t payload_bytes = 0;
+        std::uint64_t compressed = 0;
+        DeflateCounters deflate;
+    };
+
+    void publish_snapshot();
+    void remove_from_topic(const std::string& topic, const Subscriber* subscriber);
+    void enqueue(const std::shared_ptr<Subscriber>& subscriber, const SharedFramePtr& frame);
+    void schedule(const std::shared_ptr<Subscriber>& subscriber);
+
+    // Called with the subscriber's mutex held
+    void push_locked(Subscriber& subscriber, const SharedFramePtr& frame);
+    SharedFramePtr pop_locked(Subscriber& subscriber);
+    void clear_locked(Subscriber& subscriber);
+    void drop_locked(Subscriber& subscriber, const SharedFrame& frame);
+    void resync_locked(Subscriber& subscriber, Delivery& totals);
+    bool close_locked(Subscriber& subscriber, const char* reason);
+
+    // Ping, close or abandon one connection; false once it is gone
+    bool check_liveness(const std::shared_ptr<Subscriber>& subscriber, std::int64_t now_ms,
+                        const SharedFramePtr& ping);
+    void abandon(const std::shared_ptr<Subscriber>& subscriber);
+    void heartbeat_loop();
+    void deliver(Subscriber& subscriber, const SharedFrame& frame, Delivery& totals);
+    void sender_loop();
+};
@@ -0,0 +1,89 @@
+#include "deflate_stream.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// zlib rejects 8 for raw deflate, and larger windows are not valid deflate
+int clamp_window_bits(int bits) {
+    return std::min(15, std::max(9, bits));
+}
+
+} // namespace
+
+DeflateParams negotiate_deflate(const DeflateOptions& options, const crow::request& req) {
+    DeflateParams params;
+
+    const char* compress = req.url_params.get("compress");
+    if (!options.enabled || compress == nullptr || std::strcmp(compress, "deflate") != 0) {
+        return params;
+    }
+
+    params.enabled = true;
+    params.window_bits = clamp_window_bits(options.window_bits);
+    if (const char* bits = req.url_params.get("window_bits")) {
+        params.window_bits = std::min(params.window_bits, clamp_window_bits(std::atoi(bits)));
+    }
+
+    params.context_takeover = options.context_takeover;
+    if (const char* takeover = req.url_params.get("context_takeover")) {
+        params.context_takeover = params.context_takeover && std::strcmp(takeover, "0") != 0;
+    }
+    return params;
+}
+
+DeflateStream::DeflateStream(int window_bits, int level, bool context_takeover)
+    : window_bits_(clamp_window_bits(window_bits)), level_(level), context_takeover_(context_takeover) {
+    std::memset(&stream_, 0, sizeof(stream_));
+    // Negative window bits select raw deflate, without zlib header or checksum
+    if (deflateInit2(&stream_, level_, Z_DEFLATED, -window_bits_, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("deflateInit2 failed");
+    }
+}
+
+DeflateStream::~DeflateStream() {
+    deflateEnd(&stream_);
+}
+
+void DeflateStream::compress(std::string_view message, std::string& out, DeflateCounters& counters) {
+    auto start = std::chrono::steady_clock::now();
+
+    int flush = context_takeover_ ? Z_SYNC_FLUSH : Z_FINISH;
+    std::size_t offset = out.size();
+    out.resize(offset + deflateBound(&stream_, message.size()) + 8);
+
+    stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(message.data()));
+    stream_.avail_in = static_cast<uInt>(message.size());
+
+    while (true) {
+        stream_.next_out = reinterpret_cast<Bytef*>(&out[offset]);
+        stream_.avail_out = static_cast<uInt>(out.size() - offset);
+
+        int rc = deflate(&stream_, flush);
+        offset = out.size() - stream_.avail_out;
+        if (rc == Z_STREAM_ERROR) {
+            throw std::runtime_error("deflate failed");
+        }
+
+        bool done = flush == Z_FINISH ? rc == Z_STREAM_END : stream_.avail_out != 0;
+        if (done) {
+            break;
+        }
+        out.resize(out.size() * 2);
+    }
+    out.resize(offset);
+
+    if (context_takeover_) {
+        // The client appends the empty stored block back before inflating
+        out.resize(out.size() - 4);
+    } else {
+        deflateReset(&stream_);
+    }
+
+    counters.calls += 1;
+    counters.ns += static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "crow.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <zlib.h>
+
+// Server-side compression settings
+struct DeflateOptions {
+    bool enabled = true;
+    int window_bits = 15;          // 9..15, the most a client may be sent
+    bool context_takeover = true;  // allow clients to keep the dictionary between messages
+    std::size_t min_size = 256;    // smaller payloads are sent uncompressed
+    int level = Z_DEFAULT_COMPRESSION;
+};
+
+// What one connection negotiated
+struct DeflateParams {
+    bool enabled = false;
+    int window_bits = 15;
+    bool context_takeover = false;
+};
+
+// Crow writes the RFC 6455 frame header itself and has no hook for RSV1, so
+// permessage-deflate cannot be negotiated in the handshake. Compression is
+// negotiated in the /ws URL instead, mirroring the RFC 7692 parameters:
+//
+//   /ws?compress=deflate[&window_bits=N][&context_takeover=0]
+//
+// For such clients every binary message starts with one of these flags, and
+// compressed messages are sent as binary whatever their original type.
+enum DeflateFrameFlag : unsigned char {
+    RawBinary = 0,
+    DeflatedText = 1,
+    DeflatedBinary = 2
+};
+
+// Parameters for this connection, limited by the server options
+DeflateParams negotiate_deflate(const DeflateOptions& options, const crow::request& req);
+
+struct DeflateCounters {
+    std::uint64_t calls = 0; // messages actually run through deflate
+    std::uint64_t ns = 0;    // time spent in deflate
+};
+
+// Raw deflate compressor for websocket messages.
+//
+// With context takeover the stream keeps its window between messages, which
+// compresses repetitive JSON much better but costs one compressor per
+// connection. Each message ends with a sync flush whose 00 00 ff ff tail is
+// stripped, as in RFC 7692; the client's inflater keeps its state too.
+//
+// Without it the stream is reset after every message, each message is a
+// complete deflate stream, and the output depends only on the payload, so a
+// broadcast can be compressed once and shared by every such client.
+class DeflateStream {
+public:
+    DeflateStream(int window_bits, int level, bool context_takeover);
+    ~DeflateStream();
+
+    DeflateStream(const DeflateStream&) = delete;
+    DeflateStream& operator=(const DeflateStream&) = delete;
+
+    int window_bits() const { return window_bits_; }
+    int level() const { return level_; }
+
+    // Appends the compressed message to out
+    void compress(std::string_view message, std::string& out, DeflateCounters& counters);
+
+private:
+    z_stream stream_;
+    int window_bits_;
+    int level_;
+    bool context_takeover_;
+};
@@ -0,0 +1,82 @@
+#include "gpio_backend.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <stdexcept>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+SimulatedGpioBackend::SimulatedGpioBackend(unsigned line_count)
+    : words_((line_count + 63) / 64, 0) {}
+
+void SimulatedGpioBackend::write_word(std::size_t word, std::uint64_t values, std::uint64_t mask) {
+    std::lock_guard<std::mutex> _(mutex_);
+    if (word >= words_.size()) {
+        return;
+    }
+    words_[word] = (words_[word] & ~mask) | (values & mask);
+    ++write_count_;
+}
+
+std::uint64_t SimulatedGpioBackend::word(std::size_t index) const {
+    std::lock_guard<std::mutex> _(mutex_);
+    return index < words_.size() ? words_[index] : 0;
+}
+
+std::uint64_t SimulatedGpioBackend::write_count() const {
+    std::lock_guard<std::mutex> _(mutex_);
+    return write_count_;
+}
+
+GpioChipBackend::GpioChipBackend(const std::string& chip_path, unsigned line_count, unsigned first_offset) {
+    chip_fd_ = ::open(chip_path.c_str(), O_RDWR | O_CLOEXEC);
+    if (chip_fd_ < 0) {
+        throw std::runtime_error("cannot open " + chip_path + ": " + std::strerror(errno));
+    }
+
+    for (unsigned first = 0; first < line_count; first += GPIO_V2_LINES_MAX) {
+        unsigned count = line_count - first < GPIO_V2_LINES_MAX ? line_count - first : GPIO_V2_LINES_MAX;
+
+        gpio_v2_line_request request;
+        std::memset(&request, 0, sizeof(request));
+        for (unsigned i = 0; i < count; ++i) {
+            request.offsets[i] = first_offset + first + i;
+        }
+        std::strncpy(request.consumer, "crow-gpio", sizeof(request.consumer) - 1);
+        request.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+        request.num_lines = count;
+
+        if (::ioctl(chip_fd_, GPIO_V2_GET_LINE_IOCTL, &request) < 0) {
+            int error = errno;
+            for (int fd : line_fds_) {
+                ::close(fd);
+            }
+            ::close(chip_fd_);
+            throw std::runtime_error("cannot request lines on " + chip_path + ": " + std::strerror(error));
+        }
+        line_fds_.push_back(request.fd);
+    }
+}
+
+GpioChipBackend::~GpioChipBackend() {
+    for (int fd : line_fds_) {
+        ::close(fd);
+    }
+    if (chip_fd_ >= 0) {
+        ::close(chip_fd_);
+    }
+}
+
+void GpioChipBackend::write_word(std::size_t word, std::uint64_t values, std::uint64_t mask) {
+    if (word >= line_fds_.size()) {
+        return;
+    }
+
+    gpio_v2_line_values line_values;
+    line_values.bits = values;
+    line_values.mask = mask;
+    if (::ioctl(line_fds_[word], GPIO_V2_LINE_SET_VALUES_IOCTL, &line_values) < 0) {
+        throw std::runtime_error(std::string("cannot set gpio lines: ") + std::strerror(errno));
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Hardware side of the GPIO registry.
+//
+// Lines are addressed in words of 64, matching both the registry's packed
+// bitset and the Linux GPIO v2 uAPI, which sets up to 64 lines of one request
+// with a single ioctl. A batch of pin changes therefore reaches the hardware
+// as one write per touched word.
+class GpioBackend {
+public:
+    virtual ~GpioBackend() = default;
+
+    virtual const char* name() const = 0;
+
+    // Drive the lines selected by mask in the given word to values
+    virtual void write_word(std::size_t word, std::uint64_t values, std::uint64_t mask) = 0;
+};
+
+// In-memory lines, for development machines and for exercising the registry
+class SimulatedGpioBackend : public GpioBackend {
+public:
+    explicit SimulatedGpioBackend(unsigned line_count);
+
+    const char* name() const override { return "simulated"; }
+    void write_word(std::size_t word, std::uint64_t values, std::uint64_t mask) override;
+
+    std::uint64_t word(std::size_t index) const;
+    std::uint64_t write_count() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<std::uint64_t> words_;
+    std::uint64_t write_count_ = 0;
+};
+
+// Lines of a Linux gpiochip character device (/dev/gpiochipN), requested as
+// outputs through the v2 uAPI in chunks of 64 lines
+class GpioChipBackend : public GpioBackend {
+public:
+    // Throws std::runtime_error if the chip or lines cannot be opened
+    GpioChipBackend(const std::string& chip_path, unsigned line_count, unsigned first_offset = 0);
+    ~GpioChipBackend() override;
+
+    GpioChipBackend(const GpioChipBackend&) = delete;
+    GpioChipBackend& operator=(const GpioChipBackend&) = delete;
+
+    const char* name() const override { return "gpiochip"; }
+    void write_word(std::size_t word, std::uint64_t values, std::uint64_t mask) override;
+
+private:
+    int chip_fd_ = -1;
+    std::vector<int> line_fds_; // one line request per word
+};
@@ -0,0 +1,284 @@
+#include "gpio_registry.h"
+#include "json_template.h"
+
+namespace {
+
+void append_le(std::string& out, std::uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        out += static_cast<char>(value >> (8 * i));
+    }
+}
+
+} // namespace
+
+GpioRegistry::GpioRegistry(BroadcastHub& hub, std::unique_ptr<GpioBackend> backend, unsigned pin_count,
+                           std::chrono::milliseconds tick)
+    : hub_(hub), backend_(std::move(backend)), pin_count_(pin_count), word_count_((pin_count + 63) / 64),
+      tick_(tick), words_(new std::atomic<std::uint64_t>[word_count_]), published_words_(word_count_, 0) {
+    for (std::size_t w = 0; w < word_count_; ++w) {
+        words_[w].store(0, std::memory_order_relaxed);
+    }
+
+    resync_target_ = std::make_shared<ResyncTarget>();
+    resync_target_->registry = this;
+    const GpioEncoding encodings[] = {GpioEncoding::Json, GpioEncoding::Binary};
+    for (GpioEncoding encoding : encodings) {
+        auto target = resync_target_;
+        resync_[static_cast<int>(encoding)] = std::make_shared<const SnapshotSource>([target, encoding] {
+            std::lock_guard<std::mutex> _(target->mutex);
+            return target->registry ? target->registry->snapshot_frame(encoding) : SharedFramePtr();
+        });
+    }
+
+    publisher_ = std::thread([this] { publish_loop(); });
+}
+
+GpioRegistry::~GpioRegistry() {
+    {
+        std::lock_guard<std::mutex> _(stop_mutex_);
+        stopping_ = true;
+    }
+    stop_cv_.notify_all();
+    publisher_.join();
+
+    std::lock_guard<std::mutex> _(resync_target_->mutex);
+    resync_target_->registry = nullptr;
+}
+
+bool GpioRegistry::toggle(unsigned pin, bool& new_value) {
+    if (pin == 0 || pin > pin_count_) {
+        return false;
+    }
+    apply({PinChange{pin, PinChange::Op::Toggle}});
+    new_value = get(pin);
+    return true;
+}
+
+bool GpioRegistry::set(unsigned pin, bool value) {
+    if (pin == 0 || pin > pin_count_) {
+        return false;
+    }
+    apply({PinChange{pin, value ? PinChange::Op::Set : PinChange::Op::Clear}});
+    return true;
+}
+
+bool GpioRegistry::get(unsigned pin) const {
+    if (pin == 0 || pin > pin_count_) {
+        return false;
+    }
+    unsigned index = pin - 1;
+    return words_[index / 64].load(std::memory_order_acquire) & (std::uint64_t(1) << (index % 64));
+}
+
+std::size_t GpioRegistry::apply(const std::vector<PinChange>& changes) {
+    std::lock_guard<std::mutex> _(write_mutex_);
+
+    std::vector<std::uint64_t> values(word_count_);
+    std::vector<std::uint64_t> touched(word_count_, 0);
+    for (std::size_t w = 0; w < word_count_; ++w) {
+        values[w] = words_[w].load(std::memory_order_relaxed);
+    }
+
+    std::size_t applied = 0;
+    for (const auto& change : changes) {
+        if (change.pin == 0 || change.pin > pin_count_) {
+            continue;
+        }
+
+        unsigned index = change.pin - 1;
+        std::uint64_t bit = std::uint64_t(1) << (index % 64);
+        std::uint64_t& value = values[index / 64];
+
+        switch (change.op) {
+        case PinChange::Op::Set:
+            value |= bit;
+            break;
+        case PinChange::Op::Clear:
+            value &= ~bit;
+            break;
+        case PinChange::Op::Toggle:
+            value ^= bit;
+            break;
+        }
+        touched[index / 64] |= bit;
+        ++applied;
+    }
+
+    if (applied == 0) {
+        return 0;
+    }
+
+    // Each word reaches the bitset as soon as the hardware has taken it. If
+    // a write fails part way through, the words before it stay changed on
+    // both sides and the rest unchanged on both, so the bitset still matches
+    // the lines; the changes that did land are published before rethrowing.
+    bool committed = false;
+    try {
+        for (std::size_t w = 0; w < word_count_; ++w) {
+            if (touched[w]) {
+                backend_->write_word(w, values[w], touched[w]);
+                words_[w].store(values[w], std::memory_order_release);
+                committed = true;
+            }
+        }
+    } catch (...) {
+        if (committed) {
+            generation_.fetch_add(1, std::memory_order_release);
+        }
+        throw;
+    }
+    generation_.fetch_add(1, std::memory_order_release);
+
+    return applied;
+}
+
+SharedFramePtr GpioRegistry::snapshot_frame(GpioEncoding encoding) const {
+    std::uint64_t generation = 0;
+    std::vector<std::uint64_t> words = copy_words(generation);
+
+    std::vector<std::uint64_t> all(word_count_, ~std::uint64_t(0));
+    if (pin_count_ % 64) {
+        all.back() = (std::uint64_t(1) << (pin_count_ % 64)) - 1;
+    }
+    return state_frame(encoding, true, words, all, generation);
+}
+
+std::string GpioRegistry::topic(GpioEncoding encoding, unsigned pin) {
+    std::string name = encoding == GpioEncoding::Binary ? "gpio.bin" : "gpio";
+    if (pin != 0) {
+        name += '/';
+        name += std::to_string(pin);
+    }
+    return name;
+}
+
+std::vector<std::uint64_t> GpioRegistry::copy_words(std::uint64_t& generation) const {
+    // Under the write lock a batch is either fully visible or not at all
+    std::lock_guard<std::mutex> _(write_mutex_);
+
+    std::vector<std::uint64_t> words(word_count_);
+    for (std::size_t w = 0; w < word_count_; ++w) {
+        words[w] = words_[w].load(std::memory_order_relaxed);
+    }
+    generation = generation_.load(std::memory_order_relaxed);
+    return words;
+}
+
+void GpioRegistry::publish_loop() {
+    std::unique_lock<std::mutex> lock(stop_mutex_);
+    while (!stop_cv_.wait_for(lock, tick_, [this] { return stopping_; })) {
+        lock.unlock();
+        publish_changes();
+        lock.lock();
+    }
+}
+
+void GpioRegistry::publish_changes() {
+    if (generation_.load(std::memory_order_acquire) == published_generation_) {
+        return;
+    }
+
+    std::uint64_t generation = 0;
+    std::vector<std::uint64_t> words = copy_words(generation);
+
+    std::vector<std::uint64_t> changed(word_count_);
+    bool any_changed = false;
+    for (std::size_t w = 0; w < word_count_; ++w) {
+        changed[w] = words[w] ^ published_words_[w];
+        any_changed = any_changed || changed[w] != 0;
+    }
+
+    published_generation_ = generation;
+    published_words_ = std::move(words);
+
+    // Toggles that cancelled out within the tick cost nothing
+    if (!any_changed) {
+        return;
+    }
+
+    const GpioEncoding encodings[] = {GpioEncoding::Json, GpioEncoding::Binary};
+    for (GpioEncoding encoding : encodings) {
+        std::string all_pins = topic(encoding);
+        if (hub_.has_subscribers(all_pins)) {
+            hub_.publish(all_pins, state_frame(encoding, false, published_words_, changed, generation));
+        }
+    }
+
+    std::vector<std::uint64_t> single(word_count_, 0);
+    for (std::size_t w = 0; w < word_count_; ++w) {
+        std::uint64_t mask = changed[w];
+        while (mask) {
+            std::uint64_t bit = mask & (~mask + 1);
+            mask &= mask - 1;
+
+            unsigned pin = static_cast<unsigned>(w * 64 + __builtin_ctzll(bit) + 1);
+            single[w] = bit;
+            for (GpioEncoding encoding : encodings) {
+                std::string one_pin = topic(encoding, pin);
+                if (hub_.has_subscribers(one_pin)) {
+                    hub_.publish(one_pin, state_frame(encoding, false, published_words_, single, generation));
+                }
+            }
+            single[w] = 0;
+        }
+    }
+}
+
+SharedFramePtr GpioRegistry::state_frame(GpioEncoding encoding, bool full, const std::vector<std::uint64_t>& words,
+                                         const std::vector<std::uint64_t>& masks, std::uint64_t generation) const {
+    // Only updates can leave a client behind if dropped
+    SnapshotSourcePtr resync = full ? nullptr : resync_[static_cast<int>(encoding)];
+    if (encoding == GpioEncoding::Binary) {
+        return SharedFrame::binary(state_binary(full, words, masks, generation), std::move(resync));
+    }
+    return SharedFrame::text(state_json(full, words, masks, generation), std::move(resync));
+}
+
+std::string GpioRegistry::state_json(bool full, const std::vector<std::uint64_t>& words,
+                                     const std::vector<std::uint64_t>& masks, std::uint64_t generation) const {
+    std::size_t pins = 0;
+    for (std::uint64_t mask : masks) {
+        pins += static_cast<std::size_t>(__builtin_popcountll(mask));
+    }
+
+    // Sized for the longest form of every field, so appends never reallocate
+    std::string json;
+    json.reserve(80 + pins * sizeof(",\"gpio4294967295\":false"));
+    json += full ? "{\"type\":\"gpio_state\",\"generation\":" : "{\"type\":\"gpio_update\",\"generation\":";
+    fastjson::append_value(json, generation);
+    json += ",\"pins\":";
+    fastjson::append_value(json, pin_count_);
+
+    for (std::size_t w = 0; w < word_count_; ++w) {
+        std::uint64_t mask = masks[w];
+        while (mask) {
+            unsigned bit = static_cast<unsigned>(__builtin_ctzll(mask));
+            mask &= mask - 1;
+
+            json += ",\"gpio";
+            fastjson::append_value(json, w * 64 + bit + 1);
+            json += (words[w] & (std::uint64_t(1) << bit)) ? "\":true" : "\":false";
+        }
+    }
+
+    json += '}';
+    return json;
+}
+
+std::string GpioRegistry::state_binary(bool full, const std::vector<std::uint64_t>& words,
+                                       const std::vector<std::uint64_t>& masks, std::uint64_t generation) const {
+    std::string frame;
+    frame.reserve(16 + 16 * word_count_);
+    frame += static_cast<char>(full ? 1 : 2);
+    frame += static_cast<char>(1);
+    append_le(frame, 0, 2);
+    append_le(frame, pin_count_, 4);
+    append_le(frame, generation, 8);
+    for (std::size_t w = 0; w < word_count_; ++w) {
+        append_le(frame, words[w] & masks[w], 8);
+    }
+    for (std::size_t w = 0; w < word_count_; ++w) {
+        append_le(frame, masks[w], 8);
+    }
+    return frame;
+}
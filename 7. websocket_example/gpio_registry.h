@@ -0,0 +1,128 @@
+#pragma once
+
+#include "broadcast_hub.h"
+#include "gpio_backend.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Wire formats for GPIO state. Binary is negotiated with the
+// "gpio.v1.bin" websocket subprotocol; everyone else gets JSON.
+enum class GpioEncoding { Json, Binary };
+
+const char* const GPIO_BINARY_PROTOCOL = "gpio.v1.bin";
+
+struct PinChange {
+    enum class Op { Set, Clear, Toggle };
+
+    unsigned pin; // numbered from 1
+    Op op;
+};
+
+// N-pin GPIO registry shared by the HTTP routes and the websocket dashboards.
+//
+// Pin values are a packed bitset of atomic 64-bit words, so reads take no
+// lock. Writes are serialized so the hardware backend and the bitset agree;
+// a batch of changes costs one backend write per touched word and a single
+// generation bump. A publisher thread wakes once per tick and, if the
+// generation moved, broadcasts one frame holding only the pins whose value
+// differs from the last published state. Frames carry absolute values and the
+// generation, so clients can apply them in any order and ignore stale ones.
+//
+// Update frames carry a snapshot source, so a dashboard whose queue
+// overflowed and lost one is sent a fresh gpio_state before anything else
+// instead of staying wrong until the pins change again.
+//
+// Updates go to the "gpio" topic, and each changed pin also to "gpio/<pin>"
+// when some dashboard watches that pin alone. Binary clients use the same
+// topics under "gpio.bin". Each encoding is only built when its topic has
+// subscribers.
+//
+// JSON: {"type":"gpio_update","generation":G,"pins":N,"gpio1":true,...}
+//
+// Binary, all fields little-endian, W = (N + 63) / 64:
+//   u8 type (1 = state, 2 = update), u8 version (1), u16 reserved,
+//   u32 pin count N, u64 generation,
+//   u64 values[W]   bit i of word w is pin 64 * w + i + 1, 0 outside mask
+//   u64 mask[W]     pins carried by this frame; all of them for a state
+//
+// The subprotocol only changes these frames. Heartbeats stay text: binary
+// clients are sent {"type":"ping"} like everyone else and must answer with
+// the text message {"type":"pong"} within the hub's idle_timeout, or be
+// closed. A binary message from the client is published to "chat".
+class GpioRegistry {
+public:
+    GpioRegistry(BroadcastHub& hub, std::unique_ptr<GpioBackend> backend, unsigned pin_count,
+                 std::chrono::milliseconds tick = std::chrono::milliseconds(50));
+    ~GpioRegistry();
+
+    GpioRegistry(const GpioRegistry&) = delete;
+    GpioRegistry& operator=(const GpioRegistry&) = delete;
+
+    unsigned pin_count() const { return pin_count_; }
+    const GpioBackend& backend() const { return *backend_; }
+
+    // Pins are numbered from 1; return false for pins out of range
+    bool toggle(unsigned pin, bool& new_value);
+    bool set(unsigned pin, bool value);
+    bool get(unsigned pin) const;
+
+    // Apply changes in order, with one backend write per touched word and one
+    // broadcast. Pins out of range are skipped; returns the number applied.
+    // Rethrows a backend failure; words written before it stay applied.
+    std::size_t apply(const std::vector<PinChange>& changes);
+
+    std::uint64_t generation() const { return generation_.load(std::memory_order_acquire); }
+
+    // Full state, sent to clients when they connect
+    SharedFramePtr snapshot_frame(GpioEncoding encoding = GpioEncoding::Json) const;
+
+    // Topic for all pins (pin 0) or a single pin
+    static std::string topic(GpioEncoding encoding, unsigned pin = 0);
+
+private:
+    BroadcastHub& hub_;
+    std::unique_ptr<GpioBackend> backend_;
+    unsigned pin_count_;
+    std::size_t word_count_;
+    std::chrono::milliseconds tick_;
+
+    std::unique_ptr<std::atomic<std::uint64_t>[]> words_;
+    std::atomic<std::uint64_t> generation_{0};
+    mutable std::mutex write_mutex_;
+
+    // Snapshot sources for update frames, one per encoding. Frames can sit
+    // in hub queues after the registry is gone, so the sources reach it
+    // through a pointer the destructor clears under the same mutex.
+    struct ResyncTarget {
+        std::mutex mutex;
+        const GpioRegistry* registry;
+    };
+    std::shared_ptr<ResyncTarget> resync_target_;
+    SnapshotSourcePtr resync_[2];
+
+    // Publisher thread state
+    std::vector<std::uint64_t> published_words_;
+    std::uint64_t published_generation_ = 0;
+    std::mutex stop_mutex_;
+    std::condition_variable stop_cv_;
+    bool stopping_ = false;
+    std::thread publisher_;
+
+    std::vector<std::uint64_t> copy_words(std::uint64_t& generation) const;
+    void publish_loop();
+    void publish_changes();
+    SharedFramePtr state_frame(GpioEncoding encoding, bool full, const std::vector<std::uint64_t>& words,
+                               const std::vector<std::uint64_t>& masks, std::uint64_t generation) const;
+    std::string state_json(bool full, const std::vector<std::uint64_t>& words,
+                           const std::vector<std::uint64_t>& masks, std::uint64_t generation) const;
+    std::string state_binary(bool full, const std::vector<std::uint64_t>& words,
+                             const std::vector<std::uint64_t>& masks, std::uint64_t generation) const;
+};
@@ -1,91 +1,44 @@
 #include "crow.h"
-#include <unordered_set>
-#include <mutex>
-
-std::mutex mtx;
-std::unordered_set<crow::websocket::connection*> users;
-
-// GPIO states (simulating hardware)
-struct GPIOState {
-    bool gpio1 = false;
-    bool gpio2 = false;
-    bool gpio3 = false;
-};
-
-GPIOState gpio_state;
-
-void broadcast_gpio_state() {
-    std::string message = "{\"type\":\"gpio_update\",\"gpio1\":" 
-        + std::string(gpio_state.gpio1 ? "true" : "false")
-        + ",\"gpio2\":" + std::string(gpio_state.gpio2 ? "true" : "false")
-        + ",\"gpio3\":" + std::string(gpio_state.gpio3 ? "true" : "false") + "}";
-    
-    std::lock_guard<std::mutex> _(mtx);
-    for (auto u : users) {
-        u->send_text(message);
-    }
-}
-
-int main()
+#include "ws_server.h"
+#include <cstdlib>
+#include <string>
+
+// Usage: websocket_server [pin_count] [/dev/gpiochipN]
+// Without a gpiochip path the pins are simulated. Set WS_WATCH_TEMPLATES=1 to
+// pick up edits to templates/ without a restart.
+int main(int argc, char** argv)
 {
-    crow::SimpleApp app;
-
-    CROW_WEBSOCKET_ROUTE(app, "/ws")
-      .onopen([&](crow::websocket::connection& conn) {
-          CROW_LOG_INFO << "new websocket connection from " << conn.get_remote_ip();
-          std::lock_guard<std::mutex> _(mtx);
-          users.insert(&conn);
-      })
-      .onclose([&](crow::websocket::connection& conn, const std::string& reason, uint16_t) {
-          CROW_LOG_INFO << "websocket connection closed: " << reason;
-          std::lock_guard<std::mutex> _(mtx);
-          users.erase(&conn);
-      })
-      .onmessage([&](crow::websocket::connection& /*conn*/, const std::string& data, bool is_binary) {
-          std::lock_guard<std::mutex> _(mtx);
-          for (auto u : users)
-              if (is_binary)
-                  u->send_binary(data);
-              else
-                  u->send_text(data);
-      });
-
-    CROW_ROUTE(app, "/")
-    ([] {
-        char name[256];
-        gethostname(name, 256);
-        crow::mustache::context x;
-        x["servername"] = name;
-
-        auto page = crow::mustache::load("ws.html");
-        return page.render(x);
-    });
-
-    // HTTP endpoint for GPIO 1 toggle
-    CROW_ROUTE(app, "/gpio1").methods("POST"_method)
-    ([] {
-        gpio_state.gpio1 = !gpio_state.gpio1;
-        broadcast_gpio_state();
-        return crow::response(200, gpio_state.gpio1 ? "ON" : "OFF");
-    });
-
-    // HTTP endpoint for GPIO 2 toggle
-    CROW_ROUTE(app, "/gpio2").methods("POST"_method)
-    ([] {
-        gpio_state.gpio2 = !gpio_state.gpio2;
-        broadcast_gpio_state();
-        return crow::response(200, gpio_state.gpio2 ? "ON" : "OFF");
-    });
-
-    // HTTP endpoint for GPIO 3 toggle
-    CROW_ROUTE(app, "/gpio3").methods("POST"_method)
-    ([] {
-        gpio_state.gpio3 = !gpio_state.gpio3;
-        broadcast_gpio_state();
-        return crow::response(200, gpio_state.gpio3 ? "ON" : "OFF");
-    });
+    WsServerConfig config;
+    config.pin_count = argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 3;
+    if (config.pin_count == 0) {
+        config.pin_count = 3;
+    }
+    if (argc > 2) {
+        config.gpiochip = argv[2];
+    }
 
-    app.port(8080)
+    // GPIO state, published at most once per 50 ms
+    config.gpio_tick = std::chrono::milliseconds(50);
+
+    // Slow dashboards lose stale GPIO frames instead of stalling everyone else.
+    // Dashboards on metered links can ask for deflate; frames under 256 bytes
+    // (most single-pin deltas) are not worth the CPU and go out as they are.
+    config.hub.max_queued_messages = 64;
+    config.hub.max_queued_bytes = 256 * 1024;
+    config.hub.policy = SlowConsumerPolicy::Coalesce;
+    config.hub.sender_threads = 2;
+    config.hub.deflate.window_bits = 15;
+    config.hub.deflate.context_takeover = true;
+    config.hub.deflate.min_size = 256;
+    // Half-open connections are noticed within a minute
+    config.hub.heartbeat_interval = std::chrono::seconds(20);
+    config.hub.idle_timeout = std::chrono::seconds(60);
+
+    const char* watch = std::getenv("WS_WATCH_TEMPLATES");
+    config.watch_templates = watch != nullptr && std::string(watch) == "1";
+
+    WsServer server(config);
+    server.app().port(8080)
       .multithreaded()
       .run();
 }
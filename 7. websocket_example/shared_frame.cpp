@@ -0,0 +1,36 @@
+#include "shared_frame.h"
+
+SharedFramePtr SharedFrame::text(std::string payload, SnapshotSourcePtr resync) {
+    return SharedFramePtr(new SharedFrame(std::move(payload), false, std::move(resync)));
+}
+
+SharedFramePtr SharedFrame::binary(std::string payload, SnapshotSourcePtr resync) {
+    return SharedFramePtr(new SharedFrame(std::move(payload), true, std::move(resync)));
+}
+
+SharedFrame::SharedFrame(std::string payload, bool binary, SnapshotSourcePtr resync)
+    : payload_(std::move(payload)), binary_(binary), resync_(std::move(resync)) {}
+
+const std::string& SharedFrame::deflated(const DeflateOptions& options, DeflateCounters& counters) const {
+    std::call_once(deflate_once_, [&] {
+        // Without context takeover the compressor is reset after every
+        // message, so each sender thread can reuse one instead of paying for
+        // the window allocation per frame
+        thread_local std::unique_ptr<DeflateStream> stream;
+        if (!stream || stream->window_bits() != options.window_bits || stream->level() != options.level) {
+            stream = std::make_unique<DeflateStream>(options.window_bits, options.level, false);
+        }
+
+        deflated_.push_back(static_cast<char>(binary_ ? DeflatedBinary : DeflatedText));
+        stream->compress(payload_, deflated_, counters);
+    });
+    return deflated_;
+}
+
+void SharedFrame::send_to(crow::websocket::connection& conn) const {
+    if (binary_) {
+        conn.send_binary(payload_);
+    } else {
+        conn.send_text(payload_);
+    }
+}
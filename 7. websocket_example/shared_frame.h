@@ -0,0 +1,61 @@
+#pragma once
+
+#include "crow.h"
+#include "deflate_stream.h"
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+class SharedFrame;
+using SharedFramePtr = std::shared_ptr<const SharedFrame>;
+
+// Builds a frame with the complete current state, or returns null once the
+// state is gone. Attached to frames that only carry changes, so a recipient
+// that lost one of them can be sent a snapshot instead of the rest.
+using SnapshotSource = std::function<SharedFramePtr()>;
+using SnapshotSourcePtr = std::shared_ptr<const SnapshotSource>;
+
+// Immutable websocket message built once and shared by every recipient.
+//
+// The payload is serialized once by the publisher, so fan-out to N
+// connections does no per-recipient serialization. Crow writes the RFC 6455
+// frame header itself, so the frame only knows its header's size, which is
+// enough to account wire bytes.
+class SharedFrame {
+public:
+    static SharedFramePtr text(std::string payload, SnapshotSourcePtr resync = nullptr);
+    static SharedFramePtr binary(std::string payload, SnapshotSourcePtr resync = nullptr);
+
+    bool is_binary() const { return binary_; }
+    const SnapshotSourcePtr& resync() const { return resync_; }
+    const std::string& payload() const { return payload_; }
+
+    // Bytes this frame occupies on the wire
+    std::size_t wire_size() const { return header_size_for(payload_.size()) + payload_.size(); }
+
+    // Header bytes for a server frame carrying length payload bytes
+    static std::size_t header_size_for(std::size_t length) {
+        return length < 126 ? 2 : length <= 0xffff ? 4 : 10;
+    }
+
+    // Flag byte plus the payload as one complete deflate stream, for clients
+    // without context takeover. Compressed by the first sender that needs it
+    // and shared by all the others.
+    const std::string& deflated(const DeflateOptions& options, DeflateCounters& counters) const;
+
+    // Crow frames the payload itself and writes header and payload with one
+    // gathered write; the only per-recipient cost left is its buffer copy
+    void send_to(crow::websocket::connection& conn) const;
+
+private:
+    SharedFrame(std::string payload, bool binary, SnapshotSourcePtr resync);
+
+    std::string payload_;
+    bool binary_;
+    SnapshotSourcePtr resync_;
+
+    mutable std::once_flag deflate_once_;
+    mutable std::string deflated_;
+};
@@ -0,0 +1,122 @@
+#include "template_cache.h"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <poll.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+TemplateCache::TemplateCache(std::string directory, bool watch) : directory_(std::move(directory)) {
+    if (!watch) {
+        return;
+    }
+
+    inotify_fd_ = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    // Editors either rewrite in place or write a temp file and rename it over
+    if (inotify_fd_ < 0 ||
+        inotify_add_watch(inotify_fd_, directory_.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        CROW_LOG_WARNING << "cannot watch " << directory_ << ": " << std::strerror(errno)
+                         << ", templates will not reload";
+        if (inotify_fd_ >= 0) {
+            close(inotify_fd_);
+            inotify_fd_ = -1;
+        }
+        return;
+    }
+
+    stop_fd_ = eventfd(0, EFD_CLOEXEC);
+    watcher_ = std::thread([this] { watch_loop(); });
+}
+
+TemplateCache::~TemplateCache() {
+    if (watcher_.joinable()) {
+        std::uint64_t one = 1;
+        ssize_t written = write(stop_fd_, &one, sizeof(one));
+        (void)written;
+        watcher_.join();
+    }
+    if (stop_fd_ >= 0) {
+        close(stop_fd_);
+    }
+    if (inotify_fd_ >= 0) {
+        close(inotify_fd_);
+    }
+}
+
+void TemplateCache::add(const std::string& name, Values values) {
+    auto rendered = std::make_shared<const std::string>(render(name, values));
+
+    std::lock_guard<std::mutex> _(mutex_);
+    pages_[name] = Entry{std::move(values), std::move(rendered)};
+}
+
+std::shared_ptr<const std::string> TemplateCache::page(const std::string& name) const {
+    std::lock_guard<std::mutex> _(mutex_);
+    auto it = pages_.find(name);
+    return it == pages_.end() ? nullptr : it->second.rendered;
+}
+
+std::string TemplateCache::render(const std::string& name, const Values& values) const {
+    std::ifstream file(directory_ + "/" + name, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("cannot read template " + directory_ + "/" + name);
+    }
+    std::ostringstream body;
+    body << file.rdbuf();
+
+    crow::mustache::context x;
+    for (const auto& value : values) {
+        x[value.first] = value.second;
+    }
+    return crow::mustache::compile(body.str()).render_string(x);
+}
+
+void TemplateCache::reload(const std::string& name) {
+    Values values;
+    {
+        std::lock_guard<std::mutex> _(mutex_);
+        auto it = pages_.find(name);
+        if (it == pages_.end()) {
+            return;
+        }
+        values = it->second.values;
+    }
+
+    try {
+        auto rendered = std::make_shared<const std::string>(render(name, values));
+        std::lock_guard<std::mutex> _(mutex_);
+        pages_[name].rendered = std::move(rendered);
+        CROW_LOG_INFO << "reloaded template " << name;
+    } catch (const std::exception& e) {
+        CROW_LOG_WARNING << "keeping previous " << name << ": " << e.what();
+    }
+}
+
+void TemplateCache::watch_loop() {
+    alignas(inotify_event) char buffer[4096];
+
+    while (true) {
+        pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        if (fds[1].revents & POLLIN) {
+            return;
+        }
+
+        ssize_t length = read(inotify_fd_, buffer, sizeof(buffer));
+        for (ssize_t offset = 0; offset < length;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            if (event->len > 0) {
+                reload(event->name);
+            }
+            offset += sizeof(inotify_event) + event->len;
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "crow.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// Pages rendered from mustache templates whose context never changes while
+// the process runs (host name, port, ...).
+//
+// Each page is read, compiled and rendered once when it is added, so serving
+// it is a load of a shared string: no disk read, parse or gethostname per
+// request. With watch enabled an inotify thread re-renders a page when its
+// template is rewritten; a template that fails to load keeps the old page.
+class TemplateCache {
+public:
+    using Values = std::map<std::string, std::string>;
+
+    explicit TemplateCache(std::string directory, bool watch = false);
+    ~TemplateCache();
+
+    TemplateCache(const TemplateCache&) = delete;
+    TemplateCache& operator=(const TemplateCache&) = delete;
+
+    // Renders directory/name with values; throws if the template cannot be read
+    void add(const std::string& name, Values values);
+
+    // Null for pages never added
+    std::shared_ptr<const std::string> page(const std::string& name) const;
+
+private:
+    struct Entry {
+        Values values;
+        std::shared_ptr<const std::string> rendered;
+    };
+
+    std::string directory_;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Entry> pages_;
+
+    int inotify_fd_ = -1;
+    int stop_fd_ = -1;
+    std::thread watcher_;
+
+    std::string render(const std::string& name, const Values& values) const;
+    void reload(const std::string& name);
+    void watch_loop();
+};
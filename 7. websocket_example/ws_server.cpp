@@ -0,0 +1,301 @@
+#include "ws_server.h"
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// Topics every connection starts with, matching the old "everyone gets
+// everything" behaviour. Clients narrow or widen them with
+//   {"action": "subscribe",   "topics": ["gpio/3", ...]}
+//   {"action": "unsubscribe", "topics": ["gpio", "chat"]}
+// {"type": "pong"} answers the hub's heartbeat pings; any other message is
+// published to "chat". Clients of the binary GPIO subprotocol name the same
+// topics and are given their binary counterparts; they are still pinged in
+// text and must send the text pong, since idle connections are closed.
+const char* const DEFAULT_TOPICS[] = {"gpio", "chat"};
+const std::size_t MAX_TOPIC_LENGTH = 64;
+
+GpioEncoding gpio_encoding(const crow::websocket::connection& conn) {
+    return conn.get_subprotocol() == GPIO_BINARY_PROTOCOL ? GpioEncoding::Binary : GpioEncoding::Json;
+}
+
+// "gpio" and "gpio/<pin>" in the connection's encoding; other topics as given
+std::string topic_for(GpioEncoding encoding, std::string name) {
+    if (encoding == GpioEncoding::Binary && (name == "gpio" || name.compare(0, 5, "gpio/") == 0)) {
+        name.insert(4, ".bin");
+    }
+    return name;
+}
+
+// Whole-string decimal pin number within 1..pin_count, checked before it
+// is narrowed so that large values cannot wrap onto a real line
+bool parse_pin(const std::string& text, unsigned pin_count, unsigned& pin) {
+    std::uint64_t value = 0;
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (result.ec != std::errc() || result.ptr != text.data() + text.size() || value == 0 || value > pin_count) {
+        return false;
+    }
+    pin = static_cast<unsigned>(value);
+    return true;
+}
+
+bool parse_pin(const crow::json::rvalue& item, unsigned pin_count, unsigned& pin) {
+    if (item.t() != crow::json::type::Number || item.nt() == crow::json::num_type::Floating_point) {
+        return false;
+    }
+    std::int64_t value = item.i();
+    if (value < 1 || static_cast<std::uint64_t>(value) > pin_count) {
+        return false;
+    }
+    pin = static_cast<unsigned>(value);
+    return true;
+}
+
+void handle_client_message(BroadcastHub& hub, crow::websocket::connection& conn,
+                           const std::string& data, bool is_binary) {
+    hub.touch(conn);
+    if (!is_binary && data == "{\"type\":\"pong\"}") {
+        return;
+    }
+
+    if (!is_binary && !data.empty() && data[0] == '{' && data.find("\"action\"") != std::string::npos) {
+        auto message = crow::json::load(data);
+        if (message && message.has("action") && message.has("topics")) {
+            std::string action = message["action"].s();
+            if (action == "subscribe" || action == "unsubscribe") {
+                GpioEncoding encoding = gpio_encoding(conn);
+                for (const auto& topic : message["topics"]) {
+                    std::string name = topic.s();
+                    if (name.empty() || name.size() > MAX_TOPIC_LENGTH) {
+                        continue;
+                    }
+                    name = topic_for(encoding, std::move(name));
+                    if (action == "subscribe") {
+                        hub.subscribe(conn, name);
+                    } else {
+                        hub.unsubscribe(conn, name);
+                    }
+                }
+                return;
+            }
+        }
+    }
+
+    hub.publish("chat", is_binary ? SharedFrame::binary(data) : SharedFrame::text(data));
+}
+
+std::unique_ptr<GpioBackend> make_backend(const WsServerConfig& config) {
+    if (!config.gpiochip.empty()) {
+        try {
+            return std::make_unique<GpioChipBackend>(config.gpiochip, config.pin_count);
+        } catch (const std::exception& e) {
+            CROW_LOG_WARNING << e.what() << ", falling back to simulated GPIO";
+        }
+    }
+    return std::make_unique<SimulatedGpioBackend>(config.pin_count);
+}
+
+} // namespace
+
+WsServer::WsServer(const WsServerConfig& config)
+    : hub_options_(config.hub),
+      hub_(hub_options_),
+      gpio_(hub_, make_backend(config), config.pin_count, config.gpio_tick),
+      templates_(config.template_dir, config.watch_templates && !config.template_dir.empty()) {
+    CROW_LOG_INFO << "driving " << gpio_.pin_count() << " " << gpio_.backend().name() << " GPIO lines";
+
+    if (!config.template_dir.empty()) {
+        // The index page only depends on the host name, so it is rendered once
+        char hostname[256] = {};
+        gethostname(hostname, sizeof(hostname) - 1);
+        templates_.add("ws.html", {{"servername", hostname}});
+    }
+
+    register_routes();
+}
+
+void WsServer::register_routes() {
+    // Clients offering GPIO_BINARY_PROTOCOL have it selected and get binary
+    // state frames; for everyone else no subprotocol is sent back
+    CROW_WEBSOCKET_ROUTE(app_, "/ws")
+      .subprotocols({GPIO_BINARY_PROTOCOL})
+      .onaccept([this](const crow::request& req, void** userdata) {
+          // Carried to onopen, which has no access to the request
+          *userdata = new DeflateParams(negotiate_deflate(hub_options_.deflate, req));
+          return true;
+      })
+      .onopen([this](crow::websocket::connection& conn) {
+          CROW_LOG_INFO << "new websocket connection from " << conn.get_remote_ip();
+          std::unique_ptr<DeflateParams> deflate(static_cast<DeflateParams*>(conn.userdata()));
+          conn.userdata(nullptr);
+
+          GpioEncoding encoding = gpio_encoding(conn);
+          auto subscriber = hub_.add(conn, deflate ? *deflate : DeflateParams());
+          for (const char* topic : DEFAULT_TOPICS) {
+              hub_.subscribe(conn, topic_for(encoding, topic));
+          }
+          // Late joiners start from a full snapshot, then receive deltas
+          hub_.send(subscriber, gpio_.snapshot_frame(encoding));
+      })
+      .onclose([this](crow::websocket::connection& conn, const std::string& reason, uint16_t) {
+          CROW_LOG_INFO << "websocket connection closed: " << reason;
+          release(conn);
+      })
+      .onerror([this](crow::websocket::connection& conn, const std::string& error) {
+          CROW_LOG_INFO << "websocket connection error: " << error;
+          release(conn);
+      })
+      .onmessage([this](crow::websocket::connection& conn, const std::string& data, bool is_binary) {
+          try {
+              handle_client_message(hub_, conn, data, is_binary);
+          } catch (const std::exception& e) {
+              CROW_LOG_WARNING << "bad websocket message: " << e.what();
+          }
+      });
+
+    CROW_ROUTE(app_, "/")
+    ([this] {
+        auto page = templates_.page("ws.html");
+        if (!page) {
+            return crow::response(404);
+        }
+        crow::response res(*page);
+        res.set_header("Content-Type", "text/html");
+        return res;
+    });
+
+    // Connection, delivery and compression counters
+    CROW_ROUTE(app_, "/ws/stats")
+    ([this] {
+        HubStats stats = hub_.stats();
+        crow::json::wvalue x;
+        x["subscribers"] = hub_.subscriber_count();
+        x["queued_bytes"] = stats.queued_bytes;
+        x["pings_sent"] = stats.pings_sent;
+        x["idle_evictions"] = stats.idle_evictions;
+        x["close_timeouts"] = stats.close_timeouts;
+        x["slow_consumer_evictions"] = stats.slow_consumer_evictions;
+        x["frames_published"] = stats.frames_published;
+        x["frames_sent"] = stats.frames_sent;
+        x["frames_dropped"] = stats.frames_dropped;
+        x["resyncs"] = stats.resyncs;
+        x["frames_compressed"] = stats.frames_compressed;
+        x["payload_bytes_sent"] = stats.payload_bytes_sent;
+        x["wire_bytes_sent"] = stats.wire_bytes_sent;
+        x["deflate_calls"] = stats.deflate_calls;
+        x["deflate_ns_per_call"] = stats.deflate_calls ? stats.deflate_ns / stats.deflate_calls : 0;
+        return x;
+    });
+
+    // Current state of every pin
+    CROW_ROUTE(app_, "/gpio")
+    ([this] {
+        crow::response res(200, gpio_.snapshot_frame()->payload());
+        res.set_header("Content-Type", "application/json");
+        return res;
+    });
+
+    // Read (GET), toggle (POST) or set (POST {"value": true|false}) one pin
+    CROW_ROUTE(app_, "/gpio/<int>").methods("GET"_method, "POST"_method)
+    ([this](const crow::request& req, int pin) {
+        if (pin <= 0 || static_cast<unsigned>(pin) > gpio_.pin_count()) {
+            return crow::response(404, "No such GPIO");
+        }
+
+        try {
+            if (req.method == "POST"_method) {
+                auto body = crow::json::load(req.body);
+                if (body && body.has("value")) {
+                    auto type = body["value"].t();
+                    if (type != crow::json::type::True && type != crow::json::type::False) {
+                        return crow::response(400, "\"value\" must be true or false");
+                    }
+                    gpio_.set(pin, type == crow::json::type::True);
+                } else {
+                    bool value = false;
+                    gpio_.toggle(pin, value);
+                }
+            }
+        } catch (const std::exception& e) {
+            CROW_LOG_ERROR << "GPIO " << pin << " write failed: " << e.what();
+            return crow::response(500, "GPIO write failed");
+        }
+
+        return crow::response(200, gpio_.get(pin) ? "ON" : "OFF");
+    });
+
+    // Apply many pin changes with one hardware write per word and one broadcast:
+    // {"set": {"1": true, "5": false}, "toggle": [2, 3]}
+    CROW_ROUTE(app_, "/gpio/batch").methods("POST"_method)
+    ([this](const crow::request& req) {
+        auto body = crow::json::load(req.body);
+        if (!body) {
+            return crow::response(400, "Invalid JSON");
+        }
+
+        // The whole batch is rejected if any pin or value is invalid, so
+        // nothing is driven for a request that gets 400
+        std::vector<PinChange> changes;
+        try {
+            if (body.t() != crow::json::type::Object) {
+                return crow::response(400, "Invalid batch: expected an object");
+            }
+            if (body.has("set")) {
+                if (body["set"].t() != crow::json::type::Object) {
+                    return crow::response(400, "Invalid batch: \"set\" must be an object");
+                }
+                for (const auto& item : body["set"]) {
+                    unsigned pin = 0;
+                    if (!parse_pin(item.key(), gpio_.pin_count(), pin)) {
+                        return crow::response(400, "Invalid batch: no such GPIO \"" + item.key() + "\"");
+                    }
+                    auto type = item.t();
+                    if (type != crow::json::type::True && type != crow::json::type::False) {
+                        return crow::response(400, "Invalid batch: values in \"set\" must be true or false");
+                    }
+                    changes.push_back({pin, type == crow::json::type::True ? PinChange::Op::Set : PinChange::Op::Clear});
+                }
+            }
+            if (body.has("toggle")) {
+                if (body["toggle"].t() != crow::json::type::List) {
+                    return crow::response(400, "Invalid batch: \"toggle\" must be a list");
+                }
+                for (const auto& item : body["toggle"]) {
+                    unsigned pin = 0;
+                    if (!parse_pin(item, gpio_.pin_count(), pin)) {
+                        return crow::response(400, "Invalid batch: \"toggle\" holds a pin that does not exist");
+                    }
+                    changes.push_back({pin, PinChange::Op::Toggle});
+                }
+            }
+        } catch (const std::exception& e) {
+            return crow::response(400, std::string("Invalid batch: ") + e.what());
+        }
+
+        std::size_t applied = 0;
+        try {
+            applied = gpio_.apply(changes);
+        } catch (const std::exception& e) {
+            CROW_LOG_ERROR << "GPIO batch write failed: " << e.what();
+            return crow::response(500, "GPIO write failed");
+        }
+
+        crow::response res(200, "{\"applied\":" + std::to_string(applied) +
+                                    ",\"generation\":" + std::to_string(gpio_.generation()) + "}");
+        res.set_header("Content-Type", "application/json");
+        return res;
+    });
+}
+
+// Safe to call more than once. A connection that never reached onopen still
+// owns the DeflateParams from onaccept in its userdata.
+void WsServer::release(crow::websocket::connection& conn) {
+    if (!hub_.remove(conn)) {
+        delete static_cast<DeflateParams*>(conn.userdata());
+        conn.userdata(nullptr);
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "crow.h"
+#include "broadcast_hub.h"
+#include "gpio_backend.h"
+#include "gpio_registry.h"
+#include "template_cache.h"
+#include <chrono>
+#include <memory>
+#include <string>
+
+struct WsServerConfig {
+    unsigned pin_count = 3;
+    std::string gpiochip;            // empty: simulated pins
+    std::chrono::milliseconds gpio_tick{50};
+    HubOptions hub;
+    std::string template_dir = "templates"; // empty: no index page
+    bool watch_templates = false;
+};
+
+// The websocket example's state and routes, shared by the server binary and
+// the fan-out benchmark. The caller picks the port and runs app().
+class WsServer {
+public:
+    explicit WsServer(const WsServerConfig& config);
+
+    WsServer(const WsServer&) = delete;
+    WsServer& operator=(const WsServer&) = delete;
+
+    crow::SimpleApp& app() { return app_; }
+    BroadcastHub& hub() { return hub_; }
+    GpioRegistry& gpio() { return gpio_; }
+
+private:
+    HubOptions hub_options_;
+    BroadcastHub hub_;
+    GpioRegistry gpio_;
+    TemplateCache templates_;
+
+    // Declared last so it is torn down before the state its handlers use
+    crow::SimpleApp app_;
+
+    void register_routes();
+    void release(crow::websocket::connection& conn);
+};
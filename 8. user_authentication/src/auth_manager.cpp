@@ -1,5 +1,5 @@
 #include "auth_manager.h"
-#include <chrono>
+#include "coarse_clock.h"
 #include <algorithm>
 #include <cstring>
 
@@ -254,9 +254,7 @@ std::string AuthManager::bytes_to_hex(const unsigned char* bytes, size_t length)
 }
 
 int64_t AuthManager::get_current_timestamp() {
-    auto now = std::chrono::system_clock::now();
-    auto epoch = now.time_since_epoch();
-    return std::chrono::duration_cast<std::chrono::seconds>(epoch).count();
+    return coarse_clock::now_seconds();
 }
 
 } // namespace auth
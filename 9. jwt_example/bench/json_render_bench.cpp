@@ -0,0 +1,169 @@
+// JSON response rendering benchmark.
+//
+// Renders the response bodies of /api/protected, /api/profile and
+// /api/public two ways: with crow::json::wvalue built and dumped per
+// request, the way the routes used to do it, and with the prebuilt
+// fastjson::Template the routes use now. Reports nanoseconds per body and
+// the speedup for each shape. Both bodies are checked to parse back to the
+// same fields first; wvalue keeps keys in a hash map, so the text itself
+// may list them in another order.
+//
+// Usage: json_render_bench [iterations]
+#include "crow.h"
+#include "json_template.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <string>
+
+namespace
+{
+
+    // Nanoseconds per call; sink keeps the compiler from dropping the work
+    double time_per_call(long iterations, const std::function<std::string(long)> &render, std::size_t &sink)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (long i = 0; i < iterations; ++i)
+        {
+            sink += render(i).size();
+        }
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+               static_cast<double>(iterations);
+    }
+
+    // Same keys with the same values, in any order
+    bool same_fields(const crow::json::rvalue &a, const crow::json::rvalue &b)
+    {
+        if (a.t() != b.t())
+        {
+            return false;
+        }
+        if (a.t() == crow::json::type::String)
+        {
+            return a.s() == b.s();
+        }
+        if (a.t() == crow::json::type::Number)
+        {
+            return a.i() == b.i();
+        }
+        if (a.t() != crow::json::type::Object)
+        {
+            return true;
+        }
+        if (a.size() != b.size())
+        {
+            return false;
+        }
+        for (const auto &field : a)
+        {
+            if (!b.has(field.key().c_str()) || !same_fields(field, b[field.key().c_str()]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    struct Shape
+    {
+        const char *name;
+        std::function<std::string(long)> wvalue;
+        std::function<std::string(long)> fast;
+    };
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    long iterations = argc > 1 ? std::atol(argv[1]) : 1000000;
+
+    const std::string id = "1";
+    const std::string username = "admin";
+    const std::string role = "admin";
+    const long issued_at = static_cast<long>(std::time(nullptr));
+
+    // The templates from main.cpp
+    const auto protected_json = fastjson::Template::Builder()
+                                    .field("message", "This is protected content")
+                                    .begin_object("user")
+                                    .slot("id")
+                                    .slot("username")
+                                    .slot("role")
+                                    .end_object()
+                                    .slot("timestamp")
+                                    .build();
+    const auto profile_json = fastjson::Template::Builder()
+                                  .slot("id")
+                                  .slot("username")
+                                  .slot("role")
+                                  .slot("token_issued_at")
+                                  .slot("token_expires_at")
+                                  .build();
+    const auto public_json = fastjson::Template::Builder()
+                                 .field("message", "This is public content")
+                                 .slot("timestamp")
+                                 .field("server", "Crow JWT Example")
+                                 .build();
+
+    const Shape shapes[] = {
+        {"protected",
+         [&](long i)
+         {
+             crow::json::wvalue response;
+             response["message"] = "This is protected content";
+             response["user"]["id"] = id;
+             response["user"]["username"] = username;
+             response["user"]["role"] = role;
+             response["timestamp"] = issued_at + i;
+             return response.dump();
+         },
+         [&](long i)
+         { return protected_json.render(id, username, role, issued_at + i); }},
+        {"profile",
+         [&](long i)
+         {
+             crow::json::wvalue response;
+             response["id"] = id;
+             response["username"] = username;
+             response["role"] = role;
+             response["token_issued_at"] = issued_at + i;
+             response["token_expires_at"] = issued_at + i + 900;
+             return response.dump();
+         },
+         [&](long i)
+         { return profile_json.render(id, username, role, issued_at + i, issued_at + i + 900); }},
+        {"public",
+         [&](long i)
+         {
+             crow::json::wvalue response;
+             response["message"] = "This is public content";
+             response["timestamp"] = issued_at + i;
+             response["server"] = "Crow JWT Example";
+             return response.dump();
+         },
+         [&](long i)
+         { return public_json.render(issued_at + i); }},
+    };
+
+    std::size_t sink = 0;
+    std::printf("%-10s %8s %12s %12s %8s\n", "body", "bytes", "wvalue ns", "template ns", "speedup");
+    for (const auto &shape : shapes)
+    {
+        std::string expected = shape.wvalue(0);
+        std::string actual = shape.fast(0);
+        if (!same_fields(crow::json::load(expected), crow::json::load(actual)))
+        {
+            std::fprintf(stderr, "%s: bodies differ\n  wvalue:   %s\n  template: %s\n", shape.name, expected.c_str(),
+                         actual.c_str());
+            return 1;
+        }
+
+        double wvalue_ns = time_per_call(iterations, shape.wvalue, sink);
+        double fast_ns = time_per_call(iterations, shape.fast, sink);
+        std::printf("%-10s %8zu %12.1f %12.1f %7.1fx\n", shape.name, actual.size(), wvalue_ns, fast_ns,
+                    wvalue_ns / fast_ns);
+    }
+    return sink == 0 ? 1 : 0;
+}
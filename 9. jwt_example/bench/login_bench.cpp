@@ -0,0 +1,173 @@
+// Login throughput benchmark for UserDatabase.
+//
+// Fills a database with N users (1M by default) from several threads, then
+// measures two things: username lookups against the full index, and logins
+// pushed through the same BoundedWorkerPool the server uses, from client
+// threads that wait for each result the way HTTP clients do. Reports users
+// added per second, lookup cost, logins per second, login latency
+// percentiles and how many attempts the pool turned away with 503.
+//
+// Every user costs one PBKDF2 run to add, so the KDF iteration count is an
+// argument: the default of 1000 fills 1M users in minutes, while the
+// server's 100000 is the value to measure login rates with (at a smaller N).
+// Logins per second scale inversely with it.
+//
+// Usage: login_bench [users] [kdf iterations] [seconds] [login threads] [clients]
+#include "user_database.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+    std::string username_for(std::size_t i)
+    {
+        return "user" + std::to_string(i);
+    }
+
+    std::string password_for(std::size_t i)
+    {
+        return "pass" + std::to_string(i * 7919);
+    }
+
+    // One login waiting for its pool task, like a request blocked on a socket
+    struct Waiter
+    {
+        std::mutex mutex;
+        std::condition_variable done;
+        bool finished = false;
+        bool accepted = false;
+    };
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::size_t users = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    int kdf_iterations = argc > 2 ? std::atoi(argv[2]) : 1000;
+    double seconds = argc > 3 ? std::atof(argv[3]) : 10.0;
+    unsigned login_threads = argc > 4 ? static_cast<unsigned>(std::atoi(argv[4]))
+                                      : std::max(2u, std::thread::hardware_concurrency() / 2);
+    unsigned clients = argc > 5 ? static_cast<unsigned>(std::atoi(argv[5])) : login_threads * 4;
+    unsigned fill_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Start small so the fill also exercises growing the table
+    UserDatabase db(1024, kdf_iterations);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < fill_threads; ++t)
+    {
+        threads.emplace_back([&, t]
+                             {
+                                 for (std::size_t i = t; i < users; i += fill_threads)
+                                 {
+                                     db.add_user(std::to_string(i), username_for(i), password_for(i), "user");
+                                 } });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    threads.clear();
+    double fill_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("filled %zu users in %.1f s (%.0f users/s, %d KDF iterations, %u threads)\n", db.size(),
+                fill_seconds, static_cast<double>(db.size()) / fill_seconds, kdf_iterations, fill_threads);
+
+    // Lookups only: the index cost that every login pays before the KDF
+    std::mt19937_64 random(42);
+    std::vector<std::string> names;
+    for (int i = 0; i < 100000; ++i)
+    {
+        names.push_back(username_for(random() % (users * 2))); // about half are unknown
+    }
+    std::size_t hits = 0;
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < 10; ++round)
+    {
+        for (const auto &name : names)
+        {
+            hits += db.find(name) != nullptr ? 1 : 0;
+        }
+    }
+    double lookup_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+                       (names.size() * 10.0);
+    std::printf("lookup: %.1f ns, %.0f%% hits\n", lookup_ns, 100.0 * hits / (names.size() * 10.0));
+
+    // Logins through the pool; every fourth one uses a wrong password
+    BoundedWorkerPool pool(login_threads, 256);
+    std::atomic<long> succeeded{0};
+    std::atomic<long> refused{0};
+    std::atomic<long> rejected{0};
+    std::mutex latencies_mutex;
+    std::vector<double> latencies;
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+
+    start = std::chrono::steady_clock::now();
+    for (unsigned c = 0; c < clients; ++c)
+    {
+        threads.emplace_back([&, c]
+                             {
+                                 std::mt19937_64 pick(c);
+                                 std::vector<double> mine;
+                                 for (long n = 0; std::chrono::steady_clock::now() < deadline; ++n)
+                                 {
+                                     std::size_t i = pick() % users;
+                                     std::string password = n % 4 == 3 ? "wrong" : password_for(i);
+                                     std::string username = username_for(i);
+                                     Waiter waiter;
+                                     auto begin = std::chrono::steady_clock::now();
+                                     bool queued = pool.submit([&]
+                                                               {
+                                                                   bool ok = db.authenticate(username, password) != nullptr;
+                                                                   std::lock_guard<std::mutex> lock(waiter.mutex);
+                                                                   waiter.accepted = ok;
+                                                                   waiter.finished = true;
+                                                                   waiter.done.notify_one(); });
+                                     if (!queued)
+                                     {
+                                         ++rejected;
+                                         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                                         continue;
+                                     }
+                                     std::unique_lock<std::mutex> lock(waiter.mutex);
+                                     waiter.done.wait(lock, [&]
+                                                      { return waiter.finished; });
+                                     mine.push_back(std::chrono::duration<double, std::milli>(
+                                                        std::chrono::steady_clock::now() - begin)
+                                                        .count());
+                                     ++(waiter.accepted ? succeeded : refused);
+                                 }
+                                 std::lock_guard<std::mutex> lock(latencies_mutex);
+                                 latencies.insert(latencies.end(), mine.begin(), mine.end()); });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p)
+    {
+        return latencies.empty() ? 0.0 : latencies[static_cast<std::size_t>(p * (latencies.size() - 1))];
+    };
+    std::printf("%-8s %-8s %10s %10s %10s %10s %10s\n", "pool", "clients", "logins/s", "ok", "refused", "p50 ms",
+                "p99 ms");
+    std::printf("%-8u %-8u %10.0f %10ld %10ld %10.2f %10.2f\n", login_threads, clients,
+                static_cast<double>(latencies.size()) / elapsed, succeeded.load(), refused.load(), percentile(0.5),
+                percentile(0.99));
+    std::printf("503 (queue full): %ld\n", rejected.load());
+    return 0;
+}
@@ -1,7 +1,10 @@
 #include "jwt_auth.h"
+#include "token_revocation.h"
+#include "coarse_clock.h"
 #include "crow.h"
 #include <openssl/hmac.h>
 #include <openssl/sha.h>
+#include <openssl/rand.h>
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
@@ -14,12 +17,17 @@ JWTAuthenticator::JWTAuthenticator(const std::string &secret, const std::string
 std::string JWTAuthenticator::generate_token(const std::string &user_id, const std::string &username,
                                              const std::string &role, int expires_in_hours)
 {
-    auto now = std::chrono::system_clock::now();
-    auto iat = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
-    auto exp = iat + (expires_in_hours * 3600);
+    return generate_token(user_id, username, role, std::chrono::hours(expires_in_hours));
+}
+
+std::string JWTAuthenticator::generate_token(const std::string &user_id, const std::string &username,
+                                             const std::string &role, std::chrono::seconds expires_in)
+{
+    std::int64_t iat = coarse_clock::now_seconds();
+    std::int64_t exp = iat + expires_in.count();
 
     std::string header = create_header();
-    std::string payload = create_payload(user_id, username, role, exp, iat);
+    std::string payload = create_payload(user_id, username, role, exp, iat, generate_jti());
 
     std::string header_b64 = base64_url_encode(header);
     std::string payload_b64 = base64_url_encode(payload);
@@ -57,10 +65,7 @@ ValidationResult JWTAuthenticator::validate_token(const std::string &token)
         result.payload = parse_payload(payload_json);
 
         // Check expiration
-        auto now = std::chrono::system_clock::now();
-        auto current_time = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
-
-        if (current_time > result.payload.exp)
+        if (coarse_clock::now_seconds() > result.payload.exp)
         {
             result.error = "Token expired";
             return result;
@@ -80,6 +85,13 @@ ValidationResult JWTAuthenticator::validate_token(const std::string &token)
             return result;
         }
 
+        // Check revocation list
+        if (revocation_list_ && revocation_list_->is_revoked(result.payload.jti))
+        {
+            result.error = "Token revoked";
+            return result;
+        }
+
         result.valid = true;
     }
     catch (const std::exception &e)
@@ -99,6 +111,16 @@ std::string JWTAuthenticator::extract_bearer_token(const std::string &auth_heade
     return "";
 }
 
+void JWTAuthenticator::set_revocation_list(std::shared_ptr<TokenRevocationList> revocation_list)
+{
+    revocation_list_ = std::move(revocation_list);
+}
+
+std::shared_ptr<TokenRevocationList> JWTAuthenticator::revocation_list() const
+{
+    return revocation_list_;
+}
+
 std::string JWTAuthenticator::base64_url_encode(const std::string &data)
 {
     std::string encoded = crow::utility::base64encode(data, data.length());
@@ -168,6 +190,10 @@ JWTPayload JWTAuthenticator::parse_payload(const std::string &payload_json)
     payload.iat = payload_obj["iat"].i();
     payload.iss = payload_obj["iss"].s();
     payload.aud = payload_obj["aud"].s();
+    if (payload_obj.has("jti"))
+    {
+        payload.jti = payload_obj["jti"].s();
+    }
 
     return payload;
 }
@@ -181,7 +207,8 @@ std::string JWTAuthenticator::create_header()
 }
 
 std::string JWTAuthenticator::create_payload(const std::string &user_id, const std::string &username,
-                                             const std::string &role, std::int64_t exp, std::int64_t iat)
+                                             const std::string &role, std::int64_t exp, std::int64_t iat,
+                                             const std::string &jti)
 {
     crow::json::wvalue payload;
     payload["sub"] = user_id;
@@ -191,9 +218,21 @@ std::string JWTAuthenticator::create_payload(const std::string &user_id, const s
     payload["iat"] = iat;
     payload["iss"] = issuer_;
     payload["aud"] = audience_;
+    payload["jti"] = jti;
     return payload.dump();
 }
 
+std::string JWTAuthenticator::generate_jti()
+{
+    unsigned char id_bytes[16];
+    if (RAND_bytes(id_bytes, sizeof(id_bytes)) != 1)
+    {
+        throw std::runtime_error("Failed to generate token id");
+    }
+
+    return base64_url_encode(std::string(reinterpret_cast<char *>(id_bytes), sizeof(id_bytes)));
+}
+
 bool JWTAuthenticator::verify_signature(const std::string &header, const std::string &payload,
                                         const std::string &signature)
 {
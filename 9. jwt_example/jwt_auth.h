@@ -5,6 +5,9 @@
 #include <vector>
 #include <chrono>
 #include <map>
+#include <memory>
+
+class TokenRevocationList;
 
 struct JWTPayload
 {
@@ -15,6 +18,7 @@ struct JWTPayload
     std::int64_t iat; // issued at timestamp
     std::string iss;  // issuer
     std::string aud;  // audience
+    std::string jti;  // token id, used for revocation
 };
 
 struct ValidationResult
@@ -33,6 +37,8 @@ public:
     // Token generation
     std::string generate_token(const std::string &user_id, const std::string &username,
                                const std::string &role = "user", int expires_in_hours = 24);
+    std::string generate_token(const std::string &user_id, const std::string &username,
+                               const std::string &role, std::chrono::seconds expires_in);
 
     // Token validation
     ValidationResult validate_token(const std::string &token);
@@ -40,10 +46,15 @@ public:
     // Token extraction
     std::string extract_bearer_token(const std::string &auth_header);
 
+    // Token revocation
+    void set_revocation_list(std::shared_ptr<TokenRevocationList> revocation_list);
+    std::shared_ptr<TokenRevocationList> revocation_list() const;
+
 private:
     std::string secret_;
     std::string issuer_;
     std::string audience_;
+    std::shared_ptr<TokenRevocationList> revocation_list_;
 
     // Utility functions
     std::string base64_url_encode(const std::string &data);
@@ -53,7 +64,9 @@ private:
     JWTPayload parse_payload(const std::string &payload_json);
     std::string create_header();
     std::string create_payload(const std::string &user_id, const std::string &username,
-                               const std::string &role, std::int64_t exp, std::int64_t iat);
+                               const std::string &role, std::int64_t exp, std::int64_t iat,
+                               const std::string &jti);
+    std::string generate_jti();
     bool verify_signature(const std::string &header, const std::string &payload,
                           const std::string &signature);
 };
@@ -3,6 +3,7 @@
 
 #include "crow.h"
 #include "jwt_auth.h"
+#include "coarse_clock.h"
 #include <memory>
 #include <string>
 
@@ -22,6 +23,12 @@ struct JWTMiddleware : crow::ILocalMiddleware
         jwt_auth = std::make_shared<JWTAuthenticator>("my-secret-key-2024", "jwt_example", "jwt_example_users");
     }
 
+    // Share the application's authenticator (and its revocation list)
+    void set_authenticator(std::shared_ptr<JWTAuthenticator> authenticator)
+    {
+        jwt_auth = std::move(authenticator);
+    }
+
     void before_handle(crow::request &req, crow::response &res, context &ctx)
     {
         // Extract Authorization header
@@ -70,7 +77,7 @@ private:
         crow::json::wvalue error_response;
         error_response["error"] = true;
         error_response["message"] = message;
-        error_response["timestamp"] = std::time(nullptr);
+        error_response["timestamp"] = coarse_clock::now_seconds();
 
         res.code = 401;
         res.body = error_response.dump();
@@ -97,6 +104,12 @@ struct AdminJWTMiddleware : crow::ILocalMiddleware
         jwt_auth = std::make_shared<JWTAuthenticator>("my-secret-key-2024", "jwt_example", "jwt_example_users");
     }
 
+    // Share the application's authenticator (and its revocation list)
+    void set_authenticator(std::shared_ptr<JWTAuthenticator> authenticator)
+    {
+        jwt_auth = std::move(authenticator);
+    }
+
     void before_handle(crow::request &req, crow::response &res, context &ctx)
     {
         // Extract and validate JWT (same as JWTMiddleware)
@@ -149,7 +162,7 @@ private:
         crow::json::wvalue error_response;
         error_response["error"] = true;
         error_response["message"] = message;
-        error_response["timestamp"] = std::time(nullptr);
+        error_response["timestamp"] = coarse_clock::now_seconds();
 
         res.code = 401;
         res.body = error_response.dump();
@@ -162,7 +175,7 @@ private:
         crow::json::wvalue error_response;
         error_response["error"] = true;
         error_response["message"] = message;
-        error_response["timestamp"] = std::time(nullptr);
+        error_response["timestamp"] = coarse_clock::now_seconds();
 
         res.code = 403;
         res.body = error_response.dump();
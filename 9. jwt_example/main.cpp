@@ -1,43 +1,19 @@
 #include "crow.h"
 #include "jwt_middleware.h"
 #include "jwt_auth.h"
+#include "token_revocation.h"
+#include "refresh_token_store.h"
+#include "user_database.h"
+#include "worker_pool.h"
+#include "json_template.h"
+#include "coarse_clock.h"
 #include <memory>
 #include <map>
 #include <fstream>
 #include <iostream>
-
-// Simple user database
-struct User
-{
-    std::string id;
-    std::string username;
-    std::string password;
-    std::string role;
-};
-
-class UserDatabase
-{
-public:
-    UserDatabase()
-    {
-        // Add default admin user
-        users["admin"] = {"1", "admin", "adminpass123", "admin"};
-        users["user"] = {"2", "user", "userpass123", "user"};
-    }
-
-    User *authenticate(const std::string &username, const std::string &password)
-    {
-        auto it = users.find(username);
-        if (it != users.end() && it->second.password == password)
-        {
-            return &it->second;
-        }
-        return nullptr;
-    }
-
-private:
-    std::map<std::string, User> users;
-};
+#include <thread>
+#include <chrono>
+#include <algorithm>
 
 std::string load_file(const std::string &filename)
 {
@@ -52,15 +28,88 @@ std::string load_file(const std::string &filename)
     return content;
 }
 
+// Access tokens are short-lived; clients renew them with a refresh token
+const std::chrono::seconds ACCESS_TOKEN_LIFETIME = std::chrono::minutes(15);
+
+void cleanup_thread(std::shared_ptr<TokenRevocationList> revocation_list,
+                    std::shared_ptr<RefreshTokenStore> refresh_store)
+{
+    while (true)
+    {
+        std::this_thread::sleep_for(std::chrono::minutes(5));
+        std::int64_t now = coarse_clock::now_seconds();
+        revocation_list->prune_expired(now);
+        refresh_store->prune_expired(now);
+    }
+}
+
+crow::response token_response(const std::string &access_token, const std::string &refresh_token)
+{
+    crow::json::wvalue response;
+    response["success"] = true;
+    response["token"] = access_token;
+    response["token_type"] = "Bearer";
+    response["expires_in"] = static_cast<std::int64_t>(ACCESS_TOKEN_LIFETIME.count());
+    response["refresh_token"] = refresh_token;
+
+    crow::response res(200, response.dump());
+    res.set_header("Content-Type", "application/json");
+    return res;
+}
+
 int main()
 {
     // Initialize JWT authenticator and user database
     auto jwt_auth = std::make_shared<JWTAuthenticator>("my-secret-key-2024", "jwt_example", "jwt_example_users");
     UserDatabase user_db;
+    user_db.add_user("1", "admin", "adminpass123", "admin");
+    user_db.add_user("2", "user", "userpass123", "user");
+
+    // Password hashing runs on a bounded pool so a login burst cannot starve
+    // the request threads; when it is saturated logins get 503
+    unsigned login_threads = std::max(2u, std::thread::hardware_concurrency() / 2);
+    BoundedWorkerPool login_pool(login_threads, 256);
+
+    // Revoked tokens are rejected until they expire, then pruned
+    auto revocation_list = std::make_shared<TokenRevocationList>();
+    jwt_auth->set_revocation_list(revocation_list);
+
+    // Rotating refresh tokens keep password checks off the renewal path
+    auto refresh_store = std::make_shared<RefreshTokenStore>();
+
+    std::thread cleanup_worker(cleanup_thread, revocation_list, refresh_store);
+    cleanup_worker.detach();
+
+    // Hot API responses are pre-serialized; only per-request fields are filled in
+    const auto protected_json = fastjson::Template::Builder()
+                                    .field("message", "This is protected content")
+                                    .begin_object("user")
+                                    .slot("id")
+                                    .slot("username")
+                                    .slot("role")
+                                    .end_object()
+                                    .slot("timestamp")
+                                    .build();
+    const auto profile_json = fastjson::Template::Builder()
+                                  .slot("id")
+                                  .slot("username")
+                                  .slot("role")
+                                  .slot("token_issued_at")
+                                  .slot("token_expires_at")
+                                  .build();
+    const auto public_json = fastjson::Template::Builder()
+                                 .field("message", "This is public content")
+                                 .slot("timestamp")
+                                 .field("server", "Crow JWT Example")
+                                 .build();
 
     // Create Crow app with middlewares
     crow::App<JWTMiddleware, AdminJWTMiddleware> app;
 
+    // Middlewares validate with the same authenticator so they see revocations
+    app.get_middleware<JWTMiddleware>().set_authenticator(jwt_auth);
+    app.get_middleware<AdminJWTMiddleware>().set_authenticator(jwt_auth);
+
     // Serve static files
     CROW_ROUTE(app, "/")
     ([](const crow::request &req)
@@ -84,50 +133,134 @@ int main()
         res.set_header("Content-Type", "text/html");
         return res; });
 
-    // Login endpoint
-    CROW_ROUTE(app, "/api/login").methods("POST"_method)([&](const crow::request &req)
+    // Login endpoint. The handler returns as soon as the password check is
+    // queued; the pool thread builds the response and the connection's own
+    // io thread sends it, so no request thread waits on PBKDF2.
+    CROW_ROUTE(app, "/api/login").methods("POST"_method)([&](const crow::request &req, crow::response &res)
                                                          {
-        try {
-            crow::json::rvalue body = crow::json::load(req.body);
-            if (!body) {
-                crow::json::wvalue error;
-                error["error"] = true;
-                error["message"] = "Invalid JSON";
-                return crow::response(400, error.dump());
-            }
-            
-            std::string username = body["username"].s();
-            std::string password = body["password"].s();
-            
-            User* user = user_db.authenticate(username, password);
-            if (!user) {
+        crow::json::rvalue body = crow::json::load(req.body);
+        if (!body || !body.has("username") || !body.has("password") ||
+            body["username"].t() != crow::json::type::String || body["password"].t() != crow::json::type::String) {
+            crow::json::wvalue error;
+            error["error"] = true;
+            error["message"] = "Expected string \"username\" and \"password\"";
+            res.code = 400;
+            res.body = error.dump();
+            res.end();
+            return;
+        }
+
+        std::string username = body["username"].s();
+        std::string password = body["password"].s();
+
+        bool queued = login_pool.submit([&, username, password] {
+            try {
+                const User* user = user_db.authenticate(username, password);
+                if (!user) {
+                    crow::json::wvalue error;
+                    error["error"] = true;
+                    error["message"] = "Invalid credentials";
+                    res.code = 401;
+                    res.body = error.dump();
+                } else {
+                    // Generate a short-lived access token and start a refresh token family
+                    std::string token = jwt_auth->generate_token(user->id, user->username, user->role,
+                                                                 ACCESS_TOKEN_LIFETIME);
+                    std::string refresh_token = refresh_store->issue(user->id, user->username, user->role);
+
+                    crow::json::wvalue response;
+                    response["success"] = true;
+                    response["token"] = token;
+                    response["token_type"] = "Bearer";
+                    response["expires_in"] = static_cast<std::int64_t>(ACCESS_TOKEN_LIFETIME.count());
+                    response["refresh_token"] = refresh_token;
+                    response["user"]["id"] = user->id;
+                    response["user"]["username"] = user->username;
+                    response["user"]["role"] = user->role;
+
+                    res.code = 200;
+                    res.body = response.dump();
+                    res.set_header("Content-Type", "application/json");
+                }
+            } catch (const std::exception& e) {
                 crow::json::wvalue error;
                 error["error"] = true;
-                error["message"] = "Invalid credentials";
-                return crow::response(401, error.dump());
+                error["message"] = "Server error: " + std::string(e.what());
+                res.code = 500;
+                res.body = error.dump();
             }
-            
-            // Generate JWT token
-            std::string token = jwt_auth->generate_token(user->id, user->username, user->role);
-            
-            crow::json::wvalue response;
-            response["success"] = true;
-            response["token"] = token;
-            response["user"]["id"] = user->id;
-            response["user"]["username"] = user->username;
-            response["user"]["role"] = user->role;
-            
-            crow::response res(200, response.dump());
-            res.set_header("Content-Type", "application/json");
-            return res;
-            
-        } catch (const std::exception& e) {
+            // Completes on the connection's io thread
+            asio::post(*req.io_context, [&res] { res.end(); });
+        });
+
+        if (!queued) {
             crow::json::wvalue error;
             error["error"] = true;
-            error["message"] = "Server error: " + std::string(e.what());
-            return crow::response(500, error.dump());
+            error["message"] = "Too many login attempts, retry shortly";
+            res.code = 503;
+            res.body = error.dump();
+            res.set_header("Retry-After", "1");
+            res.end();
         } });
 
+    // Refresh endpoint: trade a refresh token for a new access token
+    CROW_ROUTE(app, "/api/token/refresh").methods("POST"_method)([&](const crow::request &req)
+                                                                 {
+        crow::json::rvalue body = crow::json::load(req.body);
+        if (!body || body.t() != crow::json::type::Object || !body.has("refresh_token") ||
+            body["refresh_token"].t() != crow::json::type::String) {
+            crow::json::wvalue error;
+            error["error"] = true;
+            error["message"] = "Expected string \"refresh_token\"";
+            return crow::response(400, error.dump());
+        }
+
+        RefreshResult result = refresh_store->rotate(body["refresh_token"].s());
+        if (!result.valid) {
+            if (result.reuse_detected) {
+                CROW_LOG_WARNING << "Refresh token reuse detected, session revoked";
+            }
+            crow::json::wvalue error;
+            error["error"] = true;
+            error["message"] = result.error;
+            return crow::response(401, error.dump());
+        }
+
+        std::string token = jwt_auth->generate_token(result.user_id, result.username, result.role,
+                                                     ACCESS_TOKEN_LIFETIME);
+        return token_response(token, result.refresh_token); });
+
+    // Logout endpoint: revoke the refresh token family and the presented access token
+    CROW_ROUTE(app, "/api/logout").methods("POST"_method)([&](const crow::request &req)
+                                                          {
+        // The access token is revoked first, so a bad body cannot keep it alive
+        std::string token = jwt_auth->extract_bearer_token(req.get_header_value("Authorization"));
+        if (!token.empty()) {
+            ValidationResult result = jwt_auth->validate_token(token);
+            if (result.valid) {
+                revocation_list->revoke(result.payload.jti, result.payload.exp);
+            }
+        }
+
+        crow::json::rvalue body = crow::json::load(req.body);
+        if (body && body.t() == crow::json::type::Object && body.has("refresh_token")) {
+            if (body["refresh_token"].t() != crow::json::type::String) {
+                crow::json::wvalue error;
+                error["error"] = true;
+                error["message"] = "Expected string \"refresh_token\"";
+                return crow::response(400, error.dump());
+            }
+            refresh_store->revoke(body["refresh_token"].s());
+        }
+
+        crow::json::wvalue response;
+        response["success"] = true;
+        response["message"] = "Logged out";
+
+        crow::response res(200, response.dump());
+        res.set_header("Content-Type", "application/json");
+        return res; });
+
     // Protected route (requires valid JWT)
     CROW_ROUTE(app, "/api/protected")
         .CROW_MIDDLEWARES(app, JWTMiddleware)([&](const crow::request &req)
@@ -135,14 +268,8 @@ int main()
         // Access JWT payload from middleware context
         auto& ctx = app.get_context<JWTMiddleware>(req);
         
-        crow::json::wvalue response;
-        response["message"] = "This is protected content";
-        response["user"]["id"] = ctx.payload.user_id;
-        response["user"]["username"] = ctx.payload.username;
-        response["user"]["role"] = ctx.payload.role;
-        response["timestamp"] = std::time(nullptr);
-        
-        crow::response res(200, response.dump());
+        crow::response res(200, protected_json.render(ctx.payload.user_id, ctx.payload.username,
+                                                      ctx.payload.role, coarse_clock::now_seconds()));
         res.set_header("Content-Type", "application/json");
         return res; });
 
@@ -152,14 +279,8 @@ int main()
                                               {
         auto& ctx = app.get_context<JWTMiddleware>(req);
         
-        crow::json::wvalue profile;
-        profile["id"] = ctx.payload.user_id;
-        profile["username"] = ctx.payload.username;
-        profile["role"] = ctx.payload.role;
-        profile["token_issued_at"] = ctx.payload.iat;
-        profile["token_expires_at"] = ctx.payload.exp;
-        
-        crow::response res(200, profile.dump());
+        crow::response res(200, profile_json.render(ctx.payload.user_id, ctx.payload.username,
+                                                    ctx.payload.role, ctx.payload.iat, ctx.payload.exp));
         res.set_header("Content-Type", "application/json");
         return res; });
 
@@ -202,16 +323,74 @@ int main()
         res.set_header("Content-Type", "application/json");
         return res; });
 
+    // Revoke a token (admin only)
+    CROW_ROUTE(app, "/api/admin/revoke")
+        .methods("POST"_method)
+        .CROW_MIDDLEWARES(app, AdminJWTMiddleware)([&](const crow::request &req)
+                                                   {
+        crow::json::rvalue body = crow::json::load(req.body);
+        if (!body || body.t() != crow::json::type::Object) {
+            crow::json::wvalue error;
+            error["error"] = true;
+            error["message"] = "Invalid JSON";
+            return crow::response(400, error.dump());
+        }
+
+        // s() and i() throw on other types, which would surface as a 500
+        if ((body.has("token") && body["token"].t() != crow::json::type::String) ||
+            (body.has("jti") && body["jti"].t() != crow::json::type::String) ||
+            (body.has("exp") && (body["exp"].t() != crow::json::type::Number ||
+                                 body["exp"].nt() == crow::json::num_type::Floating_point))) {
+            crow::json::wvalue error;
+            error["error"] = true;
+            error["message"] = "Expected string \"token\" or \"jti\", and integer \"exp\"";
+            return crow::response(400, error.dump());
+        }
+
+        std::string jti;
+        std::int64_t expires_at = 0;
+
+        if (body.has("token")) {
+            // Revoke by full token; only tokens that still validate need an entry
+            ValidationResult result = jwt_auth->validate_token(body["token"].s());
+            if (!result.valid) {
+                crow::json::wvalue error;
+                error["error"] = true;
+                error["message"] = "Token is not active: " + result.error;
+                return crow::response(400, error.dump());
+            }
+            jti = result.payload.jti;
+            expires_at = result.payload.exp;
+        } else if (body.has("jti")) {
+            // Without an expiry, keep the entry for the longest token lifetime
+            jti = body["jti"].s();
+            expires_at = body.has("exp") ? body["exp"].i() : coarse_clock::now_seconds() + 24 * 3600;
+        }
+
+        if (jti.empty()) {
+            crow::json::wvalue error;
+            error["error"] = true;
+            error["message"] = "Expected \"token\" or \"jti\"";
+            return crow::response(400, error.dump());
+        }
+
+        revocation_list->revoke(jti, expires_at);
+
+        crow::json::wvalue response;
+        response["success"] = true;
+        response["jti"] = jti;
+        response["revoked_until"] = expires_at;
+        response["revoked_tokens"] = revocation_list->size();
+
+        crow::response res(200, response.dump());
+        res.set_header("Content-Type", "application/json");
+        return res; });
+
     // Unprotected route
     CROW_ROUTE(app, "/api/public")
-    ([](const crow::request &req)
+    ([&public_json](const crow::request &req)
      {
-        crow::json::wvalue response;
-        response["message"] = "This is public content";
-        response["timestamp"] = std::time(nullptr);
-        response["server"] = "Crow JWT Example";
-        
-        crow::response res(200, response.dump());
+        crow::response res(200, public_json.render(coarse_clock::now_seconds()));
         res.set_header("Content-Type", "application/json");
         return res; });
 
@@ -224,11 +403,14 @@ int main()
     std::cout << "  - GET  /              - Main page" << std::endl;
     std::cout << "  - GET  /login.html    - Login page" << std::endl;
     std::cout << "  - POST /api/login     - Login endpoint" << std::endl;
+    std::cout << "  - POST /api/token/refresh - Rotate refresh token, issue access token" << std::endl;
+    std::cout << "  - POST /api/logout    - Revoke refresh and access tokens" << std::endl;
     std::cout << "  - GET  /api/public    - Public endpoint (no auth)" << std::endl;
     std::cout << "  - GET  /api/protected - Protected endpoint (JWT required)" << std::endl;
     std::cout << "  - GET  /api/profile   - User profile (JWT required)" << std::endl;
     std::cout << "  - GET  /api/admin     - Admin endpoint (admin JWT required)" << std::endl;
     std::cout << "  - GET  /api/admin/users - Admin users list (admin JWT required)" << std::endl;
+    std::cout << "  - POST /api/admin/revoke - Revoke a token (admin JWT required)" << std::endl;
 
     app.port(18080).multithreaded().run();
     return 0;
@@ -0,0 +1,160 @@
+#include "refresh_token_store.h"
+#include "coarse_clock.h"
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+#include <stdexcept>
+
+RefreshTokenStore::RefreshTokenStore(std::int64_t ttl_seconds)
+    : ttl_seconds_(ttl_seconds) {}
+
+std::string RefreshTokenStore::issue(const std::string &user_id, const std::string &username,
+                                     const std::string &role)
+{
+    std::int64_t now = current_timestamp();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::uint64_t family_id = next_family_id_++;
+    families_[family_id] = {user_id, username, role, now + ttl_seconds_};
+    return issue_locked(family_id, now);
+}
+
+RefreshResult RefreshTokenStore::rotate(const std::string &refresh_token)
+{
+    RefreshResult result;
+    result.valid = false;
+    result.reuse_detected = false;
+
+    std::int64_t now = current_timestamp();
+    std::string key = digest(refresh_token);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = tokens_.find(key);
+    if (it == tokens_.end())
+    {
+        result.error = "Unknown refresh token";
+        return result;
+    }
+
+    auto family = families_.find(it->second.family_id);
+    if (family == families_.end())
+    {
+        result.error = "Refresh token revoked";
+        return result;
+    }
+
+    if (it->second.used)
+    {
+        // A consumed token came back: someone else holds a copy of it
+        families_.erase(family);
+        result.reuse_detected = true;
+        result.error = "Refresh token reuse detected";
+        return result;
+    }
+
+    if (now > it->second.expires_at)
+    {
+        result.error = "Refresh token expired";
+        return result;
+    }
+
+    // Consumed tokens are kept until they expire so reuse can be detected
+    it->second.used = true;
+
+    family->second.expires_at = now + ttl_seconds_;
+    result.user_id = family->second.user_id;
+    result.username = family->second.username;
+    result.role = family->second.role;
+    result.refresh_token = issue_locked(family->first, now);
+    result.valid = true;
+
+    return result;
+}
+
+bool RefreshTokenStore::revoke(const std::string &refresh_token)
+{
+    std::string key = digest(refresh_token);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = tokens_.find(key);
+    if (it == tokens_.end())
+    {
+        return false;
+    }
+
+    return families_.erase(it->second.family_id) > 0;
+}
+
+std::size_t RefreshTokenStore::prune_expired(std::int64_t now)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::size_t removed = 0;
+    for (auto it = tokens_.begin(); it != tokens_.end();)
+    {
+        if (now > it->second.expires_at || families_.find(it->second.family_id) == families_.end())
+        {
+            it = tokens_.erase(it);
+            ++removed;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    for (auto it = families_.begin(); it != families_.end();)
+    {
+        if (now > it->second.expires_at)
+        {
+            it = families_.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    return removed;
+}
+
+std::string RefreshTokenStore::issue_locked(std::uint64_t family_id, std::int64_t now)
+{
+    std::string token = random_token();
+    tokens_[digest(token)] = {family_id, now + ttl_seconds_, false};
+    return token;
+}
+
+std::string RefreshTokenStore::random_token()
+{
+    static const char hex[] = "0123456789abcdef";
+
+    unsigned char token_bytes[32];
+    if (RAND_bytes(token_bytes, sizeof(token_bytes)) != 1)
+    {
+        throw std::runtime_error("Failed to generate refresh token");
+    }
+
+    std::string token;
+    token.reserve(sizeof(token_bytes) * 2);
+    for (unsigned char byte : token_bytes)
+    {
+        token += hex[byte >> 4];
+        token += hex[byte & 0x0f];
+    }
+    return token;
+}
+
+std::string RefreshTokenStore::digest(const std::string &token)
+{
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    SHA256(reinterpret_cast<const unsigned char *>(token.data()), token.size(), hash);
+    return std::string(reinterpret_cast<char *>(hash), sizeof(hash));
+}
+
+std::int64_t RefreshTokenStore::current_timestamp()
+{
+    return coarse_clock::now_seconds();
+}
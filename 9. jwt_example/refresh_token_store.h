@@ -0,0 +1,74 @@
+#ifndef REFRESH_TOKEN_STORE_H
+#define REFRESH_TOKEN_STORE_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+struct RefreshResult
+{
+    bool valid;
+    bool reuse_detected;
+    std::string user_id;
+    std::string username;
+    std::string role;
+    std::string refresh_token; // rotated token to hand back to the client
+    std::string error;
+};
+
+// Opaque, rotating refresh tokens.
+//
+// Tokens are random strings; only their SHA-256 digest is stored. Every token
+// belongs to a family started at login. Refreshing consumes the presented token
+// and issues the next one in the same family. Presenting an already consumed
+// token means it leaked, so the whole family is revoked.
+class RefreshTokenStore
+{
+public:
+    explicit RefreshTokenStore(std::int64_t ttl_seconds = 7 * 24 * 3600);
+
+    // Start a new family (login)
+    std::string issue(const std::string &user_id, const std::string &username, const std::string &role);
+
+    // Consume a token and issue its successor
+    RefreshResult rotate(const std::string &refresh_token);
+
+    // Revoke the token's whole family (logout)
+    bool revoke(const std::string &refresh_token);
+
+    // Drop expired tokens and families. Returns the number of tokens removed.
+    std::size_t prune_expired(std::int64_t now);
+
+    std::int64_t ttl_seconds() const { return ttl_seconds_; }
+
+private:
+    struct Family
+    {
+        std::string user_id;
+        std::string username;
+        std::string role;
+        std::int64_t expires_at;
+    };
+
+    struct Entry
+    {
+        std::uint64_t family_id;
+        std::int64_t expires_at;
+        bool used;
+    };
+
+    std::int64_t ttl_seconds_;
+    std::uint64_t next_family_id_ = 1;
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, Entry> tokens_;      // digest -> entry
+    std::unordered_map<std::uint64_t, Family> families_; // family id -> owner
+
+    std::string issue_locked(std::uint64_t family_id, std::int64_t now);
+    static std::string random_token();
+    static std::string digest(const std::string &token);
+    static std::int64_t current_timestamp();
+};
+
+#endif // REFRESH_TOKEN_STORE_H
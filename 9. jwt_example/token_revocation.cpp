@@ -0,0 +1,147 @@
+#include "token_revocation.h"
+#include <functional>
+#include <mutex>
+
+TokenRevocationList::TokenRevocationList(std::size_t expected_tokens)
+{
+    // ~16 bits per expected token keeps the false positive rate of a blocked
+    // filter with 6 probes well under 1%
+    std::size_t wanted_blocks = (expected_tokens * 16 + 511) / 512;
+    std::size_t block_count = 1;
+    while (block_count < wanted_blocks)
+    {
+        block_count <<= 1;
+    }
+
+    block_mask_ = block_count - 1;
+    blocks_.reset(new Block[block_count]());
+}
+
+void TokenRevocationList::revoke(const std::string &jti, std::int64_t expires_at)
+{
+    if (jti.empty())
+    {
+        return;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+
+    auto it = revoked_.find(jti);
+    if (it != revoked_.end())
+    {
+        if (expires_at > it->second)
+        {
+            it->second = expires_at;
+        }
+        return;
+    }
+
+    revoked_.emplace(jti, expires_at);
+    filter_add(hash_jti(jti), blocks_.get());
+}
+
+bool TokenRevocationList::is_revoked(const std::string &jti) const
+{
+    if (jti.empty())
+    {
+        return false;
+    }
+
+    std::uint64_t h = hash_jti(jti);
+    const Block &block = blocks_[h & block_mask_];
+    std::uint64_t bits = mix(h);
+
+    for (int i = 0; i < PROBES; ++i)
+    {
+        unsigned bit = static_cast<unsigned>(bits >> (i * 9)) & 511u;
+        std::uint64_t word = block.words[bit >> 6].load(std::memory_order_acquire);
+        if (!(word & (std::uint64_t(1) << (bit & 63))))
+        {
+            return false; // definitely not revoked
+        }
+    }
+
+    // Possible hit, confirm against the exact set
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return revoked_.find(jti) != revoked_.end();
+}
+
+std::size_t TokenRevocationList::prune_expired(std::int64_t now)
+{
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+
+    std::size_t removed = 0;
+    for (auto it = revoked_.begin(); it != revoked_.end();)
+    {
+        if (it->second < now)
+        {
+            it = revoked_.erase(it);
+            ++removed;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    if (removed == 0)
+    {
+        return 0;
+    }
+
+    // Bloom filters cannot delete, so rebuild from the surviving entries.
+    // Every rebuilt word is a subset of the live word and still holds the bits
+    // of all remaining entries, so copying word by word never lets a revoked
+    // token through to concurrent readers.
+    std::size_t block_count = block_mask_ + 1;
+    std::unique_ptr<Block[]> rebuilt(new Block[block_count]());
+    for (const auto &entry : revoked_)
+    {
+        filter_add(hash_jti(entry.first), rebuilt.get());
+    }
+
+    for (std::size_t b = 0; b < block_count; ++b)
+    {
+        for (std::size_t w = 0; w < WORDS_PER_BLOCK; ++w)
+        {
+            blocks_[b].words[w].store(rebuilt[b].words[w].load(std::memory_order_relaxed),
+                                      std::memory_order_release);
+        }
+    }
+
+    return removed;
+}
+
+std::size_t TokenRevocationList::size() const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return revoked_.size();
+}
+
+std::uint64_t TokenRevocationList::hash_jti(const std::string &jti)
+{
+    return mix(std::hash<std::string>{}(jti) ^ 0x9e3779b97f4a7c15ULL);
+}
+
+std::uint64_t TokenRevocationList::mix(std::uint64_t h)
+{
+    // splitmix64 finalizer
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+void TokenRevocationList::filter_add(std::uint64_t h, Block *blocks) const
+{
+    Block &block = blocks[h & block_mask_];
+    std::uint64_t bits = mix(h);
+
+    for (int i = 0; i < PROBES; ++i)
+    {
+        unsigned bit = static_cast<unsigned>(bits >> (i * 9)) & 511u;
+        block.words[bit >> 6].fetch_or(std::uint64_t(1) << (bit & 63), std::memory_order_release);
+    }
+}
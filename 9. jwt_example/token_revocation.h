@@ -0,0 +1,56 @@
+#ifndef TOKEN_REVOCATION_H
+#define TOKEN_REVOCATION_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+// Revocation list for JWTs keyed by their "jti" claim.
+//
+// Lookups go through a blocked Bloom filter first: every jti maps to a single
+// 64-byte block, so the common "not revoked" answer costs one cache line and no
+// lock. Only a filter hit falls through to the exact set, which also records
+// each token's expiry so entries can be pruned once the token would be rejected
+// as expired anyway.
+class TokenRevocationList
+{
+public:
+    explicit TokenRevocationList(std::size_t expected_tokens = 65536);
+
+    // Revoke a token until its expiration timestamp (seconds since epoch)
+    void revoke(const std::string &jti, std::int64_t expires_at);
+
+    // Fast path used on every validation
+    bool is_revoked(const std::string &jti) const;
+
+    // Drop entries whose token has expired and rebuild the filter.
+    // Returns the number of entries removed.
+    std::size_t prune_expired(std::int64_t now);
+
+    std::size_t size() const;
+
+private:
+    static constexpr std::size_t WORDS_PER_BLOCK = 8; // 512 bits, one cache line
+    static constexpr int PROBES = 6;
+
+    struct alignas(64) Block
+    {
+        std::atomic<std::uint64_t> words[WORDS_PER_BLOCK];
+    };
+
+    std::size_t block_mask_;
+    std::unique_ptr<Block[]> blocks_;
+
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<std::string, std::int64_t> revoked_; // jti -> expiry
+
+    static std::uint64_t hash_jti(const std::string &jti);
+    static std::uint64_t mix(std::uint64_t h);
+    void filter_add(std::uint64_t h, Block *blocks) const;
+};
+
+#endif // TOKEN_REVOCATION_H
@@ -0,0 +1,154 @@
+#include "user_database.h"
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+#include <functional>
+#include <stdexcept>
+
+UserDatabase::Table::Table(std::size_t slot_count)
+    : mask(slot_count - 1), slots(new std::atomic<const User *>[slot_count])
+{
+    for (std::size_t i = 0; i < slot_count; ++i)
+    {
+        slots[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+// Only called with the write mutex held, for a user not in the table
+void UserDatabase::Table::insert(const User *user)
+{
+    std::size_t i = user->key_hash & mask;
+    while (slots[i].load(std::memory_order_relaxed) != nullptr)
+    {
+        i = (i + 1) & mask;
+    }
+    slots[i].store(user, std::memory_order_release);
+}
+
+UserDatabase::UserDatabase(std::size_t capacity, int kdf_iterations)
+    : kdf_iterations_(kdf_iterations)
+{
+    // Keep the load factor at or below 50% so probe sequences stay short
+    std::size_t slot_count = 16;
+    while (slot_count < capacity * 2)
+    {
+        slot_count <<= 1;
+    }
+
+    tables_.push_back(std::make_unique<Table>(slot_count));
+    table_.store(tables_.back().get(), std::memory_order_release);
+
+    dummy_salt_ = random_bytes(16);
+    dummy_hash_ = derive_key(random_bytes(16), dummy_salt_);
+}
+
+UserDatabase::~UserDatabase()
+{
+    // The newest table holds every user
+    const Table *table = table_.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i <= table->mask; ++i)
+    {
+        delete table->slots[i].load(std::memory_order_relaxed);
+    }
+}
+
+bool UserDatabase::add_user(const std::string &id, const std::string &username,
+                            const std::string &password, const std::string &role)
+{
+    auto user = std::make_unique<User>();
+    user->id = id;
+    user->username = username;
+    user->role = role;
+    user->salt = random_bytes(16);
+    user->password_hash = derive_key(password, user->salt);
+    user->key_hash = hash_username(username);
+
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    if (find(username) != nullptr)
+    {
+        return false; // user already exists
+    }
+
+    const Table *table = table_.load(std::memory_order_relaxed);
+    if (size_.load(std::memory_order_relaxed) + 1 > (table->mask + 1) / 2)
+    {
+        // Readers keep probing the old table until they see the new one
+        auto grown = std::make_unique<Table>((table->mask + 1) * 2);
+        for (std::size_t i = 0; i <= table->mask; ++i)
+        {
+            if (const User *existing = table->slots[i].load(std::memory_order_relaxed))
+            {
+                grown->insert(existing);
+            }
+        }
+        tables_.push_back(std::move(grown));
+        table = tables_.back().get();
+        table_.store(table, std::memory_order_release);
+    }
+
+    tables_.back()->insert(user.release());
+    size_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+const User *UserDatabase::find(std::string_view username) const
+{
+    std::uint64_t key_hash = hash_username(username);
+    const Table *table = table_.load(std::memory_order_acquire);
+
+    for (std::size_t i = key_hash & table->mask;; i = (i + 1) & table->mask)
+    {
+        const User *user = table->slots[i].load(std::memory_order_acquire);
+        if (user == nullptr)
+        {
+            return nullptr;
+        }
+        if (user->key_hash == key_hash && user->username == username)
+        {
+            return user;
+        }
+    }
+}
+
+const User *UserDatabase::authenticate(std::string_view username, const std::string &password) const
+{
+    const User *user = find(username);
+
+    const std::string &salt = user ? user->salt : dummy_salt_;
+    const std::string &expected = user ? user->password_hash : dummy_hash_;
+
+    std::string computed = derive_key(password, salt);
+    bool match = computed.size() == expected.size() &&
+                 CRYPTO_memcmp(computed.data(), expected.data(), computed.size()) == 0;
+
+    return (user && match) ? user : nullptr;
+}
+
+std::string UserDatabase::derive_key(const std::string &password, const std::string &salt) const
+{
+    unsigned char key[SHA256_DIGEST_LENGTH];
+    if (PKCS5_PBKDF2_HMAC(password.data(), static_cast<int>(password.size()),
+                          reinterpret_cast<const unsigned char *>(salt.data()), static_cast<int>(salt.size()),
+                          kdf_iterations_, EVP_sha256(), sizeof(key), key) != 1)
+    {
+        throw std::runtime_error("Password hashing failed");
+    }
+
+    return std::string(reinterpret_cast<char *>(key), sizeof(key));
+}
+
+std::uint64_t UserDatabase::hash_username(std::string_view username)
+{
+    return std::hash<std::string_view>{}(username);
+}
+
+std::string UserDatabase::random_bytes(std::size_t length)
+{
+    std::string bytes(length, '\0');
+    if (RAND_bytes(reinterpret_cast<unsigned char *>(&bytes[0]), static_cast<int>(length)) != 1)
+    {
+        throw std::runtime_error("Failed to generate random bytes");
+    }
+    return bytes;
+}
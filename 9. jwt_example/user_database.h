@@ -0,0 +1,77 @@
+#ifndef USER_DATABASE_H
+#define USER_DATABASE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct User
+{
+    std::string id;
+    std::string username;
+    std::string role;
+    std::string password_hash; // PBKDF2-HMAC-SHA256
+    std::string salt;
+    std::uint64_t key_hash;    // hash of username, compared before the string
+};
+
+// Concurrent user index.
+//
+// Open addressing with linear probing over a power-of-two table of atomic
+// slots. Users are never removed, so lookups are lock-free and safe from any
+// Crow worker thread. Inserts are serialized by a mutex (the KDF runs before
+// it is taken); when the table passes half full it is copied into one twice
+// the size and published atomically. Older tables are kept until the
+// database is destroyed, so a lookup still probing one stays valid. Passwords
+// are stored as salted PBKDF2 hashes and compared in constant time.
+class UserDatabase
+{
+public:
+    // capacity is only the initial size; the table grows as users are added
+    explicit UserDatabase(std::size_t capacity = 1024, int kdf_iterations = 100000);
+    ~UserDatabase();
+
+    UserDatabase(const UserDatabase &) = delete;
+    UserDatabase &operator=(const UserDatabase &) = delete;
+
+    // Returns false if the username exists
+    bool add_user(const std::string &id, const std::string &username,
+                  const std::string &password, const std::string &role);
+
+    const User *find(std::string_view username) const;
+
+    // Runs the KDF even for unknown users so timing does not reveal them
+    const User *authenticate(std::string_view username, const std::string &password) const;
+
+    std::size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+private:
+    struct Table
+    {
+        std::size_t mask;
+        std::unique_ptr<std::atomic<const User *>[]> slots;
+
+        explicit Table(std::size_t slot_count);
+        void insert(const User *user);
+    };
+
+    std::atomic<const Table *> table_;
+    std::vector<std::unique_ptr<Table>> tables_; // every generation, newest last
+    std::mutex write_mutex_;
+    std::atomic<std::size_t> size_{0};
+    int kdf_iterations_;
+
+    std::string dummy_salt_;
+    std::string dummy_hash_;
+
+    std::string derive_key(const std::string &password, const std::string &salt) const;
+    static std::uint64_t hash_username(std::string_view username);
+    static std::string random_bytes(std::size_t length);
+};
+
+#endif // USER_DATABASE_H
@@ -0,0 +1,90 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size thread pool with a bounded queue.
+//
+// Used to cap how much CPU expensive work (password hashing) can take from the
+// server: when the queue is full, submit() fails immediately and the caller can
+// answer 503 instead of piling up blocked requests.
+class BoundedWorkerPool
+{
+public:
+    BoundedWorkerPool(std::size_t threads, std::size_t max_queued)
+        : max_queued_(max_queued)
+    {
+        for (std::size_t i = 0; i < threads; ++i)
+        {
+            workers_.emplace_back([this]
+                                  { run(); });
+        }
+    }
+
+    ~BoundedWorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        for (auto &worker : workers_)
+        {
+            worker.join();
+        }
+    }
+
+    BoundedWorkerPool(const BoundedWorkerPool &) = delete;
+    BoundedWorkerPool &operator=(const BoundedWorkerPool &) = delete;
+
+    // Returns false if the queue is full
+    bool submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_ || queue_.size() >= max_queued_)
+            {
+                return false;
+            }
+            queue_.push_back(std::move(task));
+        }
+        cv_.notify_one();
+        return true;
+    }
+
+private:
+    std::size_t max_queued_;
+    bool stopping_ = false;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> queue_;
+    std::vector<std::thread> workers_;
+
+    void run()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this]
+                         { return stopping_ || !queue_.empty(); });
+                if (stopping_ && queue_.empty())
+                {
+                    return;
+                }
+                task = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            task();
+        }
+    }
+};
+
+#endif // WORKER_POOL_H
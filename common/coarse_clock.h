@@ -0,0 +1,59 @@
+#ifndef COARSE_CLOCK_H
+#define COARSE_CLOCK_H
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+
+// Coarse wall clock shared by the examples.
+//
+// Handlers only need second resolution for timestamps and expiry checks.
+// CLOCK_REALTIME_COARSE is served from the vDSO without a syscall and without
+// reading the hardware clock, which makes it much cheaper than
+// system_clock::now() or time(). The preformatted HTTP-date is cached per
+// thread and only reformatted when the second changes, so there is no shared
+// buffer to race on and no timer thread to run.
+namespace coarse_clock
+{
+
+    inline std::int64_t now_seconds()
+    {
+#ifdef CLOCK_REALTIME_COARSE
+        timespec ts;
+        clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+        return static_cast<std::int64_t>(ts.tv_sec);
+#else
+        return static_cast<std::int64_t>(std::time(nullptr));
+#endif
+    }
+
+    // RFC 7231 IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+    inline std::string format_http_date(std::int64_t seconds)
+    {
+        std::time_t t = static_cast<std::time_t>(seconds);
+        std::tm tm_utc;
+        gmtime_r(&t, &tm_utc);
+
+        char buffer[32];
+        std::size_t length = std::strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &tm_utc);
+        return std::string(buffer, length);
+    }
+
+    // Current HTTP-date for response headers, valid until the next call on this thread
+    inline const std::string &http_date()
+    {
+        thread_local std::int64_t cached_second = -1;
+        thread_local std::string cached_date;
+
+        std::int64_t now = now_seconds();
+        if (now != cached_second)
+        {
+            cached_second = now;
+            cached_date = format_http_date(now);
+        }
+        return cached_date;
+    }
+
+} // namespace coarse_clock
+
+#endif // COARSE_CLOCK_H
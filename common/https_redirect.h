@@ -0,0 +1,312 @@
+#ifndef HTTPS_REDIRECT_H
+#define HTTPS_REDIRECT_H
+
+#include "coarse_clock.h"
+
+#include <asio.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+
+// HTTP to HTTPS redirector for the HTTPS examples.
+//
+// Answers every plain HTTP request with a 301 to the same host and target
+// on the HTTPS port. It needs no routing, so instead of a second Crow app
+// with its own thread pool it is a bare asio listener on one thread: read
+// the request head, write one response, close.
+//
+// Everything but the host, the target and the date is fixed, so the
+// response is assembled from a precomputed prefix and suffix. The host
+// comes from the Host header with its port dropped and is only trusted if
+// it looks like a hostname or an address. The target is cut at the end
+// of the request line and any byte that is not visible ASCII is
+// percent-encoded, so neither can inject headers.
+namespace https_redirect
+{
+
+    struct Options
+    {
+        std::string bind_address = "0.0.0.0";
+        unsigned short http_port = 8080;
+        unsigned short https_port = 8443;         // 443 leaves the port out of Location
+        std::string fallback_host = "localhost";  // when Host is missing or malformed
+        std::string extra_headers;                // complete "Name: value\r\n" lines
+        std::chrono::seconds read_timeout{10};    // for the request head
+    };
+
+    class Redirector
+    {
+    public:
+        // Binds the listening socket; throws asio::system_error if the port
+        // is taken, so a failure shows up before the thread starts
+        explicit Redirector(Options options)
+            : options_(std::move(options)),
+              acceptor_(io_context_, asio::ip::tcp::endpoint(asio::ip::make_address(options_.bind_address),
+                                                             options_.http_port)),
+              accept_retry_(io_context_)
+        {
+            prefix_ = "HTTP/1.1 301 Moved Permanently\r\nLocation: https://";
+            port_ = options_.https_port == 443 ? "" : ":" + std::to_string(options_.https_port);
+            suffix_ = "\r\nContent-Length: 0\r\nConnection: close\r\n" + options_.extra_headers + "Date: ";
+        }
+
+        ~Redirector()
+        {
+            stop();
+        }
+
+        Redirector(const Redirector &) = delete;
+        Redirector &operator=(const Redirector &) = delete;
+
+        void start()
+        {
+            accept();
+            thread_ = std::thread([this]
+                                  { io_context_.run(); });
+        }
+
+        void stop()
+        {
+            io_context_.stop();
+            if (thread_.joinable())
+            {
+                thread_.join();
+            }
+        }
+
+        unsigned short port() const
+        {
+            return acceptor_.local_endpoint().port();
+        }
+
+        // Response for one request head; public so it can be checked
+        // without a socket
+        std::string response(const char *head, std::size_t length) const
+        {
+            const char *end = head + length;
+            const char *line_end = std::find_if(head, end, [](char c)
+                                                { return c == '\r' || c == '\n'; });
+            // The target is the second field of the request line only
+            const char *target = std::find(head, line_end, ' ');
+            if (target != line_end)
+            {
+                ++target;
+            }
+            const char *target_end = std::find(target, line_end, ' ');
+            // Absolute-form, missing and garbage targets become the site root
+            if (target == target_end || *target != '/')
+            {
+                static const char root[] = "/";
+                target = root;
+                target_end = root + 1;
+            }
+
+            std::size_t host_length = 0;
+            const char *host = find_host(head, end, host_length);
+            if (host == nullptr)
+            {
+                host = options_.fallback_host.data();
+                host_length = options_.fallback_host.size();
+            }
+
+            const std::string &date = coarse_clock::http_date();
+            std::string out;
+            out.reserve(prefix_.size() + host_length + port_.size() + (target_end - target) + suffix_.size() +
+                        date.size() + 4);
+            out.append(prefix_);
+            out.append(host, host_length);
+            out.append(port_);
+            append_target(out, target, target_end);
+            out.append(suffix_);
+            out.append(date);
+            out.append("\r\n\r\n");
+            return out;
+        }
+
+    private:
+        class Session : public std::enable_shared_from_this<Session>
+        {
+        public:
+            Session(const Redirector &owner, asio::ip::tcp::socket socket)
+                : owner_(owner), socket_(std::move(socket)), timer_(socket_.get_executor())
+            {
+            }
+
+            void start()
+            {
+                auto self = shared_from_this();
+                timer_.expires_after(owner_.options_.read_timeout);
+                timer_.async_wait([self](const asio::error_code &error)
+                                  {
+                                      if (!error)
+                                      {
+                                          asio::error_code ignored;
+                                          self->socket_.close(ignored);
+                                      } });
+                read();
+            }
+
+        private:
+            const Redirector &owner_;
+            asio::ip::tcp::socket socket_;
+            asio::steady_timer timer_;
+            std::array<char, 8192> buffer_;
+            std::size_t length_ = 0;
+            std::string response_;
+
+            void read()
+            {
+                auto self = shared_from_this();
+                socket_.async_read_some(asio::buffer(buffer_.data() + length_, buffer_.size() - length_),
+                                        [self](const asio::error_code &error, std::size_t bytes)
+                                        {
+                                            if (error)
+                                            {
+                                                self->timer_.cancel();
+                                                return;
+                                            }
+                                            self->received(bytes);
+                                        });
+            }
+
+            void received(std::size_t bytes)
+            {
+                std::size_t scanned = length_ >= 3 ? length_ - 3 : 0;
+                length_ += bytes;
+                const char *begin = buffer_.data();
+                const char *end = begin + length_;
+                static const char blank_line[] = "\r\n\r\n";
+                const char *head_end = std::search(begin + scanned, end, blank_line, blank_line + 4);
+
+                // Oversized heads still get redirected from what arrived
+                if (head_end == end && length_ < buffer_.size())
+                {
+                    read();
+                    return;
+                }
+
+                response_ = owner_.response(begin, head_end - begin);
+                auto self = shared_from_this();
+                asio::async_write(socket_, asio::buffer(response_),
+                                  [self](const asio::error_code &, std::size_t)
+                                  {
+                                      asio::error_code ignored;
+                                      self->socket_.shutdown(asio::ip::tcp::socket::shutdown_both, ignored);
+                                      self->timer_.cancel();
+                                  });
+            }
+        };
+
+        Options options_;
+        asio::io_context io_context_;
+        asio::ip::tcp::acceptor acceptor_;
+        asio::steady_timer accept_retry_;
+        std::thread thread_;
+        std::string prefix_;
+        std::string port_;
+        std::string suffix_;
+
+        void accept()
+        {
+            acceptor_.async_accept([this](const asio::error_code &error, asio::ip::tcp::socket socket)
+                                   {
+                                       if (!error)
+                                       {
+                                           std::make_shared<Session>(*this, std::move(socket))->start();
+                                           accept();
+                                       }
+                                       else if (error != asio::error::operation_aborted && acceptor_.is_open())
+                                       {
+                                           // Out of descriptors (EMFILE) and the like fail again at
+                                           // once, so retrying straight away would spin a core
+                                           retry_accept();
+                                       } });
+        }
+
+        void retry_accept()
+        {
+            accept_retry_.expires_after(std::chrono::milliseconds(100));
+            accept_retry_.async_wait([this](const asio::error_code &error)
+                                     {
+                                         if (!error && acceptor_.is_open())
+                                         {
+                                             accept();
+                                         } });
+        }
+
+        // Copies the target into Location, percent-encoding every byte that
+        // is not visible ASCII so nothing can end the header line
+        static void append_target(std::string &out, const char *target, const char *target_end)
+        {
+            static const char hex[] = "0123456789ABCDEF";
+            for (const char *c = target; c != target_end; ++c)
+            {
+                unsigned char byte = static_cast<unsigned char>(*c);
+                if (byte > 0x20 && byte < 0x7f)
+                {
+                    out += *c;
+                }
+                else
+                {
+                    out += '%';
+                    out += hex[byte >> 4];
+                    out += hex[byte & 0xf];
+                }
+            }
+        }
+
+        // Host header value without its port, or nullptr if it is missing
+        // or has characters a hostname or IP literal cannot have
+        static const char *find_host(const char *begin, const char *end, std::size_t &length)
+        {
+            static const char name[] = "\nhost:";
+            const char *line = std::search(begin, end, name, name + 6,
+                                           [](char a, char b)
+                                           { return std::tolower(static_cast<unsigned char>(a)) == b; });
+            if (line == end)
+            {
+                return nullptr;
+            }
+
+            const char *value = line + 6;
+            while (value != end && (*value == ' ' || *value == '\t'))
+            {
+                ++value;
+            }
+            const char *value_end = value;
+            bool bracket = value != end && *value == '[';
+            while (value_end != end && *value_end != '\r' && *value_end != '\n' && *value_end != ' ')
+            {
+                char c = *value_end;
+                if (c == ']' && bracket)
+                {
+                    ++value_end;
+                    break;
+                }
+                if (c == ':' && !bracket)
+                {
+                    break;
+                }
+                bool allowed = std::isalnum(static_cast<unsigned char>(c)) || c == '.' || c == '-' ||
+                               (bracket && (c == ':' || value_end == value));
+                if (!allowed)
+                {
+                    return nullptr;
+                }
+                ++value_end;
+            }
+
+            length = static_cast<std::size_t>(value_end - value);
+            return length == 0 ? nullptr : value;
+        }
+    };
+
+} // namespace https_redirect
+
+#endif // HTTPS_REDIRECT_H
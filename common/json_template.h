@@ -0,0 +1,203 @@
+#ifndef JSON_TEMPLATE_H
+#define JSON_TEMPLATE_H
+
+#include <cassert>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Pre-serialized JSON responses.
+//
+// A fastjson::Template is built once at startup from the response shape: the
+// constant keys and values are serialized into text fragments, and only the
+// dynamic fields are left as slots. Rendering appends the fragments and the
+// slot values into a single reserved string, without the per-key heap nodes
+// that crow::json::wvalue allocates on every request.
+//
+//     static const auto status = fastjson::Template::Builder()
+//                                    .field("status", "ok")
+//                                    .slot("timestamp")
+//                                    .build();
+//     std::string body = status.render(std::time(nullptr));
+namespace fastjson
+{
+
+    inline void append_escaped(std::string &out, std::string_view value)
+    {
+        static const char hex[] = "0123456789abcdef";
+
+        std::size_t run_start = 0;
+        for (std::size_t i = 0; i < value.size(); ++i)
+        {
+            unsigned char c = static_cast<unsigned char>(value[i]);
+            if (c >= 0x20 && c != '"' && c != '\\')
+            {
+                continue;
+            }
+
+            out.append(value.data() + run_start, i - run_start);
+            run_start = i + 1;
+
+            switch (c)
+            {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            default:
+                out += "\\u00";
+                out += hex[c >> 4];
+                out += hex[c & 0x0f];
+            }
+        }
+        out.append(value.data() + run_start, value.size() - run_start);
+    }
+
+    inline void append_value(std::string &out, std::string_view value)
+    {
+        out += '"';
+        append_escaped(out, value);
+        out += '"';
+    }
+
+    inline void append_value(std::string &out, const std::string &value)
+    {
+        append_value(out, std::string_view(value));
+    }
+
+    inline void append_value(std::string &out, const char *value)
+    {
+        append_value(out, std::string_view(value));
+    }
+
+    inline void append_value(std::string &out, bool value)
+    {
+        out += value ? "true" : "false";
+    }
+
+    template <typename T>
+    inline typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type
+    append_value(std::string &out, T value)
+    {
+        char buffer[24];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, result.ptr);
+    }
+
+    // Pre-serialized object with dynamic slots
+    class Template
+    {
+    public:
+        class Builder
+        {
+        public:
+            Builder() : current_("{") { first_.push_back(true); }
+
+            // Constant field, serialized now
+            template <typename T>
+            Builder &field(std::string_view key, const T &value)
+            {
+                append_key(key);
+                append_value(current_, value);
+                return *this;
+            }
+
+            // Dynamic field, filled in by render()
+            Builder &slot(std::string_view key)
+            {
+                append_key(key);
+                fragments_.push_back(std::move(current_));
+                current_.clear();
+                return *this;
+            }
+
+            Builder &begin_object(std::string_view key)
+            {
+                append_key(key);
+                current_ += '{';
+                first_.push_back(true);
+                return *this;
+            }
+
+            Builder &end_object()
+            {
+                assert(first_.size() > 1 && "end_object() without begin_object()");
+                current_ += '}';
+                first_.pop_back();
+                return *this;
+            }
+
+            Template build()
+            {
+                assert(first_.size() == 1 && "unterminated begin_object()");
+                current_ += '}';
+                fragments_.push_back(std::move(current_));
+                return Template(std::move(fragments_));
+            }
+
+        private:
+            std::string current_;
+            std::vector<std::string> fragments_;
+            std::vector<bool> first_;
+
+            void append_key(std::string_view key)
+            {
+                if (!first_.back())
+                {
+                    current_ += ',';
+                }
+                first_.back() = false;
+                append_value(current_, key);
+                current_ += ':';
+            }
+        };
+
+        std::size_t slot_count() const { return fragments_.size() - 1; }
+
+        // Values are given in the order their slots were declared
+        template <typename... Args>
+        void render_into(std::string &out, const Args &...args) const
+        {
+            assert(sizeof...(Args) == slot_count() && "slot/argument count mismatch");
+
+            out.reserve(out.size() + constant_size_ + sizeof...(Args) * 24);
+            out += fragments_[0];
+
+            std::size_t index = 1;
+            (void)index;
+            ((append_value(out, args), out += fragments_[index++]), ...);
+        }
+
+        template <typename... Args>
+        std::string render(const Args &...args) const
+        {
+            std::string out;
+            render_into(out, args...);
+            return out;
+        }
+
+    private:
+        std::vector<std::string> fragments_;
+        std::size_t constant_size_ = 0;
+
+        explicit Template(std::vector<std::string> fragments)
+            : fragments_(std::move(fragments))
+        {
+            for (const auto &fragment : fragments_)
+            {
+                constant_size_ += fragment.size();
+            }
+        }
+    };
+
+} // namespace fastjson
+
+#endif // JSON_TEMPLATE_H
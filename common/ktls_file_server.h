@@ -0,0 +1,486 @@
+#ifndef KTLS_FILE_SERVER_H
+#define KTLS_FILE_SERVER_H
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+// HTTPS static file listener with kernel TLS offload.
+//
+// Crow encrypts through asio's SSL stream, which runs OpenSSL over memory
+// BIOs, so OpenSSL can never hand a Crow connection's keys to the kernel.
+// This listener owns its sockets instead: after a normal OpenSSL handshake
+// with SSL_OP_ENABLE_KTLS, OpenSSL installs the traffic keys in the Linux
+// TLS ULP and file bodies go out with SSL_sendfile(). The kernel encrypts
+// straight from the page cache, with no copy into userspace.
+//
+// If kTLS cannot be enabled for a connection (no tls module, a cipher the
+// kernel does not offload, or an OpenSSL built without kTLS), that
+// connection falls back to read() plus SSL_write(). Behaviour is the same
+// either way, and stats() shows which path was taken.
+//
+// It shares the caller's SSL_CTX, so certificates, profiles, session
+// resumption, SNI and reloads all apply. It only answers GET and HEAD for
+// files under one directory, with keep-alive, on a few blocking threads.
+// That is the right shape for a handful of large downloads, and the wrong
+// one for many small requests, which stay on Crow.
+//
+// With one connection per thread, a client that sends a byte just often
+// enough to beat the per-read timeout could hold a thread forever. A
+// watchdog thread therefore gives every connection deadlines: the handshake
+// and each request head must arrive within request_timeout_seconds, and no
+// connection lives longer than max_connection_seconds. A connection past
+// its deadline has its socket shut down, which fails whatever blocking call
+// its thread is in.
+namespace ktls
+{
+
+    struct Options
+    {
+        std::string bind_address = "0.0.0.0";
+        unsigned short port = 8444;
+        std::string root = "public";        // files are served from here
+        int threads = 4;                    // one connection per thread at a time
+        int idle_timeout_seconds = 15;      // per blocking read/write
+        int request_timeout_seconds = 20;   // whole handshake, and each request head after the last response
+        int max_connection_seconds = 600;   // downloads still running then are cut off
+        bool enable_ktls = true;            // false forces the userspace path, for comparison
+    };
+
+    struct Stats
+    {
+        std::atomic<long> connections{0};
+        std::atomic<long> ktls_connections{0}; // kernel encrypts transmitted records
+        std::atomic<long> requests{0};
+        std::atomic<long long> sendfile_bytes{0};
+        std::atomic<long long> copied_bytes{0};   // read() + SSL_write()
+    };
+
+    // True if the running kernel has the TLS ULP loaded
+    inline bool kernel_supports_ktls()
+    {
+        std::ifstream ulps("/proc/sys/net/ipv4/tcp_available_ulp");
+        std::string ulp;
+        while (ulps >> ulp)
+        {
+            if (ulp == "tls")
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    class FileServer
+    {
+    public:
+        // Binds the port; throws std::system_error if that fails
+        FileServer(SSL_CTX *ctx, Options options) : ctx_(ctx), options_(std::move(options))
+        {
+            SSL_CTX_up_ref(ctx_);
+            listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            int one = 1;
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(options_.port);
+            if (listen_fd_ < 0 || setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+                inet_pton(AF_INET, options_.bind_address.c_str(), &address.sin_addr) != 1 ||
+                bind(listen_fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 ||
+                listen(listen_fd_, SOMAXCONN) < 0)
+            {
+                int error = errno;
+                if (listen_fd_ >= 0)
+                {
+                    close(listen_fd_);
+                }
+                SSL_CTX_free(ctx_);
+                throw std::system_error(error, std::generic_category(),
+                                        "kTLS file server on port " + std::to_string(options_.port));
+            }
+        }
+
+        ~FileServer()
+        {
+            stop();
+            close(listen_fd_);
+            SSL_CTX_free(ctx_);
+        }
+
+        FileServer(const FileServer &) = delete;
+        FileServer &operator=(const FileServer &) = delete;
+
+        void start()
+        {
+            slots_ = std::vector<Slot>(static_cast<std::size_t>(options_.threads));
+            for (int i = 0; i < options_.threads; ++i)
+            {
+                threads_.emplace_back([this, i]
+                                      { accept_loop(slots_[static_cast<std::size_t>(i)]); });
+            }
+            threads_.emplace_back([this]
+                                  { watchdog_loop(); });
+        }
+
+        // Unblocks accept() and shuts down the connections in progress
+        void stop()
+        {
+            if (stopping_.exchange(true))
+            {
+                return;
+            }
+            shutdown(listen_fd_, SHUT_RDWR);
+            {
+                std::lock_guard<std::mutex> lock(slots_mutex_);
+                for (auto &slot : slots_)
+                {
+                    if (slot.fd >= 0)
+                    {
+                        shutdown(slot.fd, SHUT_RDWR);
+                    }
+                }
+            }
+            watchdog_cv_.notify_all();
+            for (auto &thread : threads_)
+            {
+                thread.join();
+            }
+        }
+
+        unsigned short port() const
+        {
+            sockaddr_in address{};
+            socklen_t length = sizeof(address);
+            getsockname(listen_fd_, reinterpret_cast<sockaddr *>(&address), &length);
+            return ntohs(address.sin_port);
+        }
+
+        const Stats &stats() const
+        {
+            return stats_;
+        }
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        // The connection a serving thread is on, for the watchdog. The fd
+        // is only closed after it is cleared here, under slots_mutex_, so
+        // the watchdog never shuts down a reused descriptor.
+        struct Slot
+        {
+            int fd = -1;
+            Clock::time_point deadline;  // the current phase's
+            Clock::time_point expires;   // max_connection_seconds after accept
+        };
+
+        SSL_CTX *ctx_;
+        Options options_;
+        int listen_fd_ = -1;
+        std::atomic<bool> stopping_{false};
+        std::vector<std::thread> threads_;
+        std::vector<Slot> slots_;
+        std::mutex slots_mutex_;
+        std::condition_variable watchdog_cv_;
+        Stats stats_;
+
+        // Starts a phase that must finish within seconds, or by the
+        // connection's expiry if that comes first
+        void set_deadline(Slot &slot, int seconds)
+        {
+            std::lock_guard<std::mutex> lock(slots_mutex_);
+            slot.deadline = std::min(Clock::now() + std::chrono::seconds(seconds), slot.expires);
+        }
+
+        void watchdog_loop()
+        {
+            std::unique_lock<std::mutex> lock(slots_mutex_);
+            while (!watchdog_cv_.wait_for(lock, std::chrono::seconds(1), [this]
+                                          { return stopping_.load(); }))
+            {
+                auto now = Clock::now();
+                for (auto &slot : slots_)
+                {
+                    if (slot.fd >= 0 && now >= slot.deadline)
+                    {
+                        shutdown(slot.fd, SHUT_RDWR);
+                        slot.deadline = Clock::time_point::max(); // once is enough
+                    }
+                }
+            }
+        }
+
+        void accept_loop(Slot &slot)
+        {
+            // The socket BIO uses write() and the kTLS path sendfile(), which
+            // raise SIGPIPE when a client hangs up mid-download and would
+            // kill the process. Blocked here, they fail with EPIPE instead.
+            sigset_t pipe;
+            sigemptyset(&pipe);
+            sigaddset(&pipe, SIGPIPE);
+            pthread_sigmask(SIG_BLOCK, &pipe, nullptr);
+
+            while (!stopping_)
+            {
+                int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd < 0)
+                {
+                    // Out of descriptors or buffers (EMFILE, ENFILE, ENOBUFS,
+                    // ENOMEM) is temporary; retrying at once would only spin
+                    if (errno != EINTR && errno != ECONNABORTED && !stopping_)
+                    {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    }
+                    continue;
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(slots_mutex_);
+                    slot.fd = fd;
+                    slot.expires = Clock::now() + std::chrono::seconds(options_.max_connection_seconds);
+                    slot.deadline = Clock::time_point::max();
+                    if (stopping_)
+                    {
+                        shutdown(fd, SHUT_RDWR);
+                    }
+                }
+                serve(fd, slot);
+                {
+                    std::lock_guard<std::mutex> lock(slots_mutex_);
+                    slot.fd = -1;
+                }
+                close(fd);
+            }
+        }
+
+        void serve(int fd, Slot &slot)
+        {
+            timeval timeout{options_.idle_timeout_seconds, 0};
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+            SSL *ssl = SSL_new(ctx_);
+            if (ssl == nullptr)
+            {
+                return;
+            }
+            // A socket BIO, so OpenSSL can push the keys into the kernel
+            SSL_set_fd(ssl, fd);
+            if (options_.enable_ktls)
+            {
+                SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+            }
+            else
+            {
+                SSL_clear_options(ssl, SSL_OP_ENABLE_KTLS);
+            }
+
+            set_deadline(slot, options_.request_timeout_seconds);
+            if (SSL_accept(ssl) == 1)
+            {
+                ++stats_.connections;
+                bool ktls = BIO_get_ktls_send(SSL_get_wbio(ssl)) > 0;
+                stats_.ktls_connections += ktls ? 1 : 0;
+
+                std::string buffer;
+                while (!stopping_ && handle_request(ssl, buffer, ktls, slot))
+                {
+                }
+                SSL_shutdown(ssl);
+            }
+            ERR_clear_error();
+            SSL_free(ssl);
+        }
+
+        // Serves one request from buffer/ssl; false to close the connection
+        bool handle_request(SSL *ssl, std::string &buffer, bool ktls, Slot &slot)
+        {
+            set_deadline(slot, options_.request_timeout_seconds);
+            std::size_t head_end;
+            while ((head_end = buffer.find("\r\n\r\n")) == std::string::npos)
+            {
+                if (buffer.size() > 16384)
+                {
+                    return false;
+                }
+                char chunk[4096];
+                int n = SSL_read(ssl, chunk, sizeof(chunk));
+                if (n <= 0)
+                {
+                    return false;
+                }
+                buffer.append(chunk, static_cast<std::size_t>(n));
+            }
+            std::string head = buffer.substr(0, head_end);
+            buffer.erase(0, head_end + 4);
+            ++stats_.requests;
+
+            // The response only has the connection's lifetime left
+            set_deadline(slot, options_.max_connection_seconds);
+
+            std::size_t method_end = head.find(' ');
+            std::size_t target_end = head.find(' ', method_end + 1);
+            if (method_end == std::string::npos || target_end == std::string::npos)
+            {
+                return send_status(ssl, 400, "Bad Request", false);
+            }
+            std::string method = head.substr(0, method_end);
+            std::string target = head.substr(method_end + 1, target_end - method_end - 1);
+            bool keep_alive = head.compare(target_end + 1, 8, "HTTP/1.1") == 0 &&
+                              !contains_token(head, "connection:", "close");
+
+            if (method != "GET" && method != "HEAD")
+            {
+                return send_status(ssl, 405, "Method Not Allowed", keep_alive);
+            }
+
+            target = target.substr(0, target.find('?'));
+            if (target.empty() || target[0] != '/' || target.find("..") != std::string::npos)
+            {
+                return send_status(ssl, 403, "Forbidden", keep_alive);
+            }
+            if (target.back() == '/')
+            {
+                target += "index.html";
+            }
+
+            int file = open((options_.root + target).c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat info;
+            if (file < 0 || fstat(file, &info) < 0 || !S_ISREG(info.st_mode))
+            {
+                if (file >= 0)
+                {
+                    close(file);
+                }
+                return send_status(ssl, 404, "Not Found", keep_alive);
+            }
+
+            std::string response = "HTTP/1.1 200 OK\r\nContent-Type: " + mime_type(target) +
+                                   "\r\nContent-Length: " + std::to_string(info.st_size) +
+                                   (keep_alive ? "\r\n\r\n" : "\r\nConnection: close\r\n\r\n");
+            bool ok = write_all(ssl, response.data(), response.size());
+            if (ok && method == "GET")
+            {
+                ok = ktls ? send_file_ktls(ssl, file, info.st_size) : send_file_copy(ssl, file, info.st_size);
+            }
+            close(file);
+            return ok && keep_alive;
+        }
+
+        bool send_file_ktls(SSL *ssl, int file, off_t size)
+        {
+            off_t offset = 0;
+            while (offset < size)
+            {
+                ossl_ssize_t sent = SSL_sendfile(ssl, file, offset, static_cast<size_t>(size - offset), 0);
+                if (sent <= 0)
+                {
+                    return false;
+                }
+                offset += sent;
+                stats_.sendfile_bytes += sent;
+            }
+            return true;
+        }
+
+        bool send_file_copy(SSL *ssl, int file, off_t size)
+        {
+            std::vector<char> chunk(64 * 1024);
+            off_t offset = 0;
+            while (offset < size)
+            {
+                ssize_t n = pread(file, chunk.data(), chunk.size(), offset);
+                if (n <= 0 || !write_all(ssl, chunk.data(), static_cast<std::size_t>(n)))
+                {
+                    return false;
+                }
+                offset += n;
+                stats_.copied_bytes += n;
+            }
+            return true;
+        }
+
+        static bool write_all(SSL *ssl, const char *data, std::size_t length)
+        {
+            while (length > 0)
+            {
+                int n = SSL_write(ssl, data, static_cast<int>(std::min<std::size_t>(length, 1 << 30)));
+                if (n <= 0)
+                {
+                    return false;
+                }
+                data += n;
+                length -= static_cast<std::size_t>(n);
+            }
+            return true;
+        }
+
+        static bool send_status(SSL *ssl, int code, const char *reason, bool keep_alive)
+        {
+            std::string response = "HTTP/1.1 " + std::to_string(code) + " " + reason +
+                                   "\r\nContent-Length: 0" +
+                                   (keep_alive ? "\r\n\r\n" : "\r\nConnection: close\r\n\r\n");
+            return write_all(ssl, response.data(), response.size()) && keep_alive;
+        }
+
+        // Case-insensitive "name: ... token" check within the request head
+        static bool contains_token(std::string head, const std::string &name, const std::string &token)
+        {
+            for (char &c : head)
+            {
+                c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+            std::size_t field = head.find("\r\n" + name);
+            if (field == std::string::npos)
+            {
+                return false;
+            }
+            std::size_t line_end = head.find("\r\n", field + 2);
+            return head.substr(field, line_end - field).find(token) != std::string::npos;
+        }
+
+        static std::string mime_type(const std::string &path)
+        {
+            static const std::pair<const char *, const char *> types[] = {
+                {".html", "text/html"}, {".css", "text/css"}, {".js", "application/javascript"},
+                {".png", "image/png"},  {".jpg", "image/jpeg"}, {".gif", "image/gif"},
+                {".txt", "text/plain"}, {".json", "application/json"}};
+            for (const auto &type : types)
+            {
+                std::size_t length = std::strlen(type.first);
+                if (path.size() >= length && path.compare(path.size() - length, length, type.first) == 0)
+                {
+                    return type.second;
+                }
+            }
+            return "application/octet-stream";
+        }
+    };
+
+} // namespace ktls
+
+#endif // KTLS_FILE_SERVER_H
@@ -0,0 +1,358 @@
+#ifndef ROUTE_METRICS_H
+#define ROUTE_METRICS_H
+
+#include "crow.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Per-route request metrics as a global middleware, served in Prometheus
+// text format.
+//
+// For each route this records completed requests by status code, the
+// number in flight, and a latency histogram. Every thread that handles
+// requests writes to its own block of counters with uncontended relaxed
+// atomics, so recording a request costs two clock reads, a route match and
+// a few increments, with no lock and no shared cache line. A scrape sums
+// the blocks of all threads.
+//
+// Latency buckets are powers of two in nanoseconds, from 1.024 us up to
+// 17.2 s. That is the exponent part of an HDR histogram. Each bucket is
+// within a factor of two, bucket selection is one count-leading-zeros, and
+// every `le` bound Prometheus sees is exact.
+//
+// Crow does not tell a middleware which rule matched, so routes are
+// declared with the same patterns as CROW_ROUTE and matched in the order
+// given (list "/<path>" last). Anything else is counted as "unmatched", so
+// the label set stays bounded. Declare every route before the app runs.
+//
+// List it first so that it also times the other middlewares:
+//
+//     crow::App<metrics::Middleware, OtherMiddleware> app;
+//     app.get_middleware<metrics::Middleware>().route("/api/status").route("/<path>");
+//
+// GET /metrics then returns the exposition text. Put it behind a firewall
+// or change the path with serve_at() if the port is public.
+namespace metrics
+{
+
+    namespace detail
+    {
+        constexpr int latency_buckets = 26; // 2^10 .. 2^34 ns, then +Inf
+        constexpr int first_bucket_bits = 10;
+        constexpr int lowest_status = 100;
+        constexpr int status_codes = 500; // 100 to 599
+
+        inline int latency_bucket(std::uint64_t nanoseconds)
+        {
+            int bits = nanoseconds == 0 ? 0 : 64 - __builtin_clzll(nanoseconds);
+            int bucket = bits - first_bucket_bits;
+            return bucket < 0 ? 0 : (bucket >= latency_buckets ? latency_buckets - 1 : bucket);
+        }
+
+        // One route's counters in one thread's block
+        struct alignas(64) RouteCounters
+        {
+            std::atomic<std::uint64_t> latency[latency_buckets];
+            std::atomic<std::uint64_t> latency_sum_ns;
+            std::atomic<std::int64_t> in_flight;
+            std::atomic<std::uint64_t> status[status_codes];
+        };
+
+        // True if url matches a CROW_ROUTE pattern. <path> takes the rest
+        // of the url, any other parameter one non-empty segment.
+        inline bool matches(const std::string &pattern, const std::string &url)
+        {
+            std::size_t p = 0;
+            std::size_t u = 0;
+            while (p < pattern.size())
+            {
+                if (pattern[p] != '<')
+                {
+                    if (u >= url.size() || url[u] != pattern[p])
+                    {
+                        return false;
+                    }
+                    ++p;
+                    ++u;
+                    continue;
+                }
+
+                std::size_t close = pattern.find('>', p);
+                if (close == std::string::npos)
+                {
+                    return false;
+                }
+                if (pattern.compare(p, close - p + 1, "<path>") == 0)
+                {
+                    return u < url.size();
+                }
+                std::size_t segment_end = url.find('/', u);
+                if (segment_end == std::string::npos)
+                {
+                    segment_end = url.size();
+                }
+                if (segment_end == u)
+                {
+                    return false;
+                }
+                bool integer = pattern.compare(p, close - p + 1, "<int>") == 0 ||
+                               pattern.compare(p, close - p + 1, "<uint>") == 0;
+                for (std::size_t i = u; integer && i < segment_end; ++i)
+                {
+                    bool sign = i == u && (url[i] == '-' || url[i] == '+');
+                    if (!sign && (url[i] < '0' || url[i] > '9'))
+                    {
+                        return false;
+                    }
+                }
+                u = segment_end;
+                p = close + 1;
+            }
+            return u == url.size();
+        }
+
+        inline std::string escape_label(const std::string &value)
+        {
+            std::string out;
+            out.reserve(value.size());
+            for (char c : value)
+            {
+                if (c == '\\' || c == '"')
+                {
+                    out += '\\';
+                    out += c;
+                }
+                else if (c == '\n')
+                {
+                    out += "\\n";
+                }
+                else
+                {
+                    out += c;
+                }
+            }
+            return out;
+        }
+    } // namespace detail
+
+    class Middleware
+    {
+    public:
+        struct context
+        {
+            std::chrono::steady_clock::time_point start;
+            detail::RouteCounters *counters = nullptr; // null for /metrics itself
+        };
+
+        Middleware() : state_(new State)
+        {
+            state_->id = next_id();
+        }
+
+        Middleware(Middleware &&) = default;
+        Middleware &operator=(Middleware &&) = default;
+
+        // Declares a route by its CROW_ROUTE pattern; throws
+        // std::logic_error once requests have been recorded
+        Middleware &route(std::string pattern)
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            if (!state_->shards.empty())
+            {
+                throw std::logic_error("metrics: route \"" + pattern + "\" declared after the first request");
+            }
+            state_->routes.push_back(std::move(pattern));
+            return *this;
+        }
+
+        // Path the exposition is served on; empty turns the endpoint off
+        // so render() can be exposed some other way
+        Middleware &serve_at(std::string path)
+        {
+            state_->path = std::move(path);
+            return *this;
+        }
+
+        void before_handle(crow::request &req, crow::response &res, context &ctx)
+        {
+            if (!state_->path.empty() && req.url == state_->path)
+            {
+                res.code = 200;
+                res.body = render();
+                res.set_header("Content-Type", "text/plain; version=0.0.4; charset=utf-8");
+                res.end();
+                return;
+            }
+
+            std::size_t route = state_->routes.size();
+            for (std::size_t i = 0; i < state_->routes.size(); ++i)
+            {
+                if (detail::matches(state_->routes[i], req.url))
+                {
+                    route = i;
+                    break;
+                }
+            }
+            ctx.counters = &shard()[route];
+            ctx.counters->in_flight.fetch_add(1, std::memory_order_relaxed);
+            ctx.start = std::chrono::steady_clock::now();
+        }
+
+        void after_handle(crow::request & /*req*/, crow::response &res, context &ctx)
+        {
+            if (ctx.counters == nullptr)
+            {
+                return;
+            }
+            auto elapsed = std::chrono::steady_clock::now() - ctx.start;
+            auto nanoseconds = static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+
+            detail::RouteCounters &counters = *ctx.counters;
+            counters.latency[detail::latency_bucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+            counters.latency_sum_ns.fetch_add(nanoseconds, std::memory_order_relaxed);
+            int status = res.code - detail::lowest_status;
+            if (status >= 0 && status < detail::status_codes)
+            {
+                counters.status[status].fetch_add(1, std::memory_order_relaxed);
+            }
+            counters.in_flight.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        // Prometheus text exposition of every route, summed over threads
+        std::string render() const
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            std::vector<std::string> labels;
+            for (const auto &pattern : state_->routes)
+            {
+                labels.push_back(detail::escape_label(pattern));
+            }
+            labels.push_back("unmatched");
+
+            std::string requests = "# HELP http_requests_total Completed requests by route and status code.\n"
+                                   "# TYPE http_requests_total counter\n";
+            std::string in_flight = "# HELP http_requests_in_flight Requests being handled by route.\n"
+                                    "# TYPE http_requests_in_flight gauge\n";
+            std::string latency = "# HELP http_request_duration_seconds Time from the first middleware to the "
+                                  "response by route.\n"
+                                  "# TYPE http_request_duration_seconds histogram\n";
+            char line[256];
+
+            for (std::size_t route = 0; route < labels.size(); ++route)
+            {
+                std::uint64_t buckets[detail::latency_buckets] = {};
+                std::uint64_t sum_ns = 0;
+                std::int64_t active = 0;
+                std::vector<std::uint64_t> status(detail::status_codes, 0);
+                for (const auto &shard : state_->shards)
+                {
+                    const detail::RouteCounters &counters = shard[route];
+                    for (int b = 0; b < detail::latency_buckets; ++b)
+                    {
+                        buckets[b] += counters.latency[b].load(std::memory_order_relaxed);
+                    }
+                    sum_ns += counters.latency_sum_ns.load(std::memory_order_relaxed);
+                    active += counters.in_flight.load(std::memory_order_relaxed);
+                    for (int s = 0; s < detail::status_codes; ++s)
+                    {
+                        status[s] += counters.status[s].load(std::memory_order_relaxed);
+                    }
+                }
+
+                const std::string &label = labels[route];
+                for (int s = 0; s < detail::status_codes; ++s)
+                {
+                    if (status[s] != 0)
+                    {
+                        std::snprintf(line, sizeof(line), "\",code=\"%d\"} %llu\n", s + detail::lowest_status,
+                                      static_cast<unsigned long long>(status[s]));
+                        requests += "http_requests_total{route=\"" + label + line;
+                    }
+                }
+
+                // Increments are not ordered across threads, so a request
+                // in flight can briefly read as -1 while it completes
+                in_flight += "http_requests_in_flight{route=\"" + label + "\"} " +
+                             std::to_string(active < 0 ? 0 : active) + "\n";
+
+                std::uint64_t cumulative = 0;
+                for (int b = 0; b < detail::latency_buckets; ++b)
+                {
+                    cumulative += buckets[b];
+                    if (b + 1 < detail::latency_buckets)
+                    {
+                        double bound = static_cast<double>(1ULL << (b + detail::first_bucket_bits)) / 1e9;
+                        std::snprintf(line, sizeof(line), "\",le=\"%.9g\"} %llu\n", bound,
+                                      static_cast<unsigned long long>(cumulative));
+                    }
+                    else
+                    {
+                        std::snprintf(line, sizeof(line), "\",le=\"+Inf\"} %llu\n",
+                                      static_cast<unsigned long long>(cumulative));
+                    }
+                    latency += "http_request_duration_seconds_bucket{route=\"" + label + line;
+                }
+                std::snprintf(line, sizeof(line), "\"} %.9f\n", static_cast<double>(sum_ns) / 1e9);
+                latency += "http_request_duration_seconds_sum{route=\"" + label + line;
+                std::snprintf(line, sizeof(line), "\"} %llu\n", static_cast<unsigned long long>(cumulative));
+                latency += "http_request_duration_seconds_count{route=\"" + label + line;
+            }
+
+            return requests + in_flight + latency;
+        }
+
+    private:
+        using Shard = std::unique_ptr<detail::RouteCounters[]>;
+
+        // Behind a pointer so the middleware stays movable: crow::App
+        // moves each middleware into its tuple when it is constructed
+        struct State
+        {
+            std::uint64_t id = 0;
+            std::vector<std::string> routes;
+            std::string path = "/metrics";
+            std::mutex mutex;
+            std::vector<Shard> shards;
+        };
+
+        std::unique_ptr<State> state_;
+
+        static std::uint64_t next_id()
+        {
+            static std::atomic<std::uint64_t> id{0};
+            return ++id;
+        }
+
+        // This thread's counters, one per route plus "unmatched"; the lock
+        // is only taken the first time a thread records a request
+        detail::RouteCounters *shard()
+        {
+            thread_local std::vector<std::pair<std::uint64_t, detail::RouteCounters *>> cache;
+            for (const auto &entry : cache)
+            {
+                if (entry.first == state_->id)
+                {
+                    return entry.second;
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            state_->shards.emplace_back(new detail::RouteCounters[state_->routes.size() + 1]());
+            cache.emplace_back(state_->id, state_->shards.back().get());
+            return state_->shards.back().get();
+        }
+    };
+
+} // namespace metrics
+
+#endif // ROUTE_METRICS_H
@@ -0,0 +1,527 @@
+#ifndef TLS_OCSP_H
+#define TLS_OCSP_H
+
+#include <netdb.h>
+#include <openssl/err.h>
+#include <openssl/ocsp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// OCSP stapling for the HTTPS examples.
+//
+// Clients that check revocation would otherwise ask the CA's OCSP responder
+// themselves before their first request. With stapling, the server sends
+// a recent signed response in the handshake instead. A background thread
+// fetches one response per certificate from the responder named in the
+// certificate (or a configured override), verifies it against the issuer
+// and refreshes it halfway to its nextUpdate. The handshake only copies
+// the cached DER out of memory.
+//
+// A failed fetch is retried after retry_interval, and the previous
+// response keeps being stapled until it expires. Certificates without a
+// responder URL or without their issuer in the chain file are skipped with
+// a log line. Only plain http:// responders are supported, which is what
+// CAs publish.
+namespace tls
+{
+
+    struct OcspOptions
+    {
+        std::string responder_url;                 // overrides the certificate's AIA URL
+        std::chrono::seconds retry_interval{60};   // after a failed fetch
+        std::chrono::seconds default_refresh{3600}; // for responses without nextUpdate
+        std::chrono::seconds timeout{5};           // connect and each read/write
+    };
+
+    class OcspStapler
+    {
+    public:
+        using Logger = std::function<void(const std::string &)>;
+
+        explicit OcspStapler(OcspOptions options = OcspOptions(),
+                             Logger log = [](const std::string &message)
+                             { std::cerr << message << std::endl; })
+            : options_(std::move(options)), log_(std::move(log)), map_(std::make_shared<const Map>())
+        {
+        }
+
+        ~OcspStapler()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            wake_.notify_all();
+            if (thread_.joinable())
+            {
+                thread_.join();
+            }
+        }
+
+        OcspStapler(const OcspStapler &) = delete;
+        OcspStapler &operator=(const OcspStapler &) = delete;
+
+        // Staples responses for every certificate in ctx, replacing what was
+        // attached under the same name before (e.g. a reloaded hostname).
+        // Fits CertificateStore::set_listener().
+        void attach(const std::string &name, SSL_CTX *ctx)
+        {
+            SSL_CTX_set_tlsext_status_cb(ctx, status_callback);
+            SSL_CTX_set_tlsext_status_arg(ctx, this);
+
+            std::vector<std::shared_ptr<Entry>> added;
+            for (long more = SSL_CTX_set_current_cert(ctx, SSL_CERT_SET_FIRST); more == 1;
+                 more = SSL_CTX_set_current_cert(ctx, SSL_CERT_SET_NEXT))
+            {
+                auto entry = make_entry(name, ctx);
+                if (entry)
+                {
+                    added.push_back(std::move(entry));
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto map = std::make_shared<Map>();
+                for (const auto &item : *std::atomic_load(&map_))
+                {
+                    if (item.second->name != name)
+                    {
+                        map->insert(item);
+                    }
+                }
+                for (const auto &entry : added)
+                {
+                    (*map)[entry->leaf] = entry;
+                }
+                std::atomic_store(&map_, std::shared_ptr<const Map>(std::move(map)));
+            }
+            wake_.notify_all();
+        }
+
+        void start()
+        {
+            if (!thread_.joinable())
+            {
+                thread_ = std::thread([this]
+                                      { refresh_loop(); });
+            }
+        }
+
+        // Certificates with a response currently being stapled
+        std::size_t stapled() const
+        {
+            std::size_t count = 0;
+            std::time_t now = std::time(nullptr);
+            for (const auto &item : *std::atomic_load(&map_))
+            {
+                auto staple = std::atomic_load(&item.second->staple);
+                count += staple && staple->expires > now ? 1 : 0;
+            }
+            return count;
+        }
+
+    private:
+        struct Staple
+        {
+            std::string der;
+            std::time_t expires;
+        };
+
+        struct Entry
+        {
+            std::string name;
+            X509 *leaf = nullptr;
+            X509 *issuer = nullptr;
+            std::string url;
+            std::shared_ptr<const Staple> staple;
+            std::time_t next_refresh = 0; // refresh thread only
+
+            ~Entry()
+            {
+                X509_free(leaf);
+                X509_free(issuer);
+            }
+        };
+
+        // Keyed by the leaf as SSL_get_certificate() returns it
+        using Map = std::unordered_map<X509 *, std::shared_ptr<Entry>>;
+
+        OcspOptions options_;
+        Logger log_;
+        std::shared_ptr<const Map> map_;
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        bool stopping_ = false;
+        std::thread thread_;
+
+        std::shared_ptr<Entry> make_entry(const std::string &name, SSL_CTX *ctx)
+        {
+            X509 *leaf = SSL_CTX_get0_certificate(ctx);
+            if (leaf == nullptr)
+            {
+                return nullptr;
+            }
+            std::string subject = subject_name(leaf);
+
+            STACK_OF(X509) *chain = nullptr;
+            SSL_CTX_get0_chain_certs(ctx, &chain);
+            X509 *issuer = nullptr;
+            for (int i = 0; chain != nullptr && i < sk_X509_num(chain); ++i)
+            {
+                if (X509_check_issued(sk_X509_value(chain, i), leaf) == X509_V_OK)
+                {
+                    issuer = sk_X509_value(chain, i);
+                    break;
+                }
+            }
+            if (issuer == nullptr)
+            {
+                log_("OCSP: no issuer in the chain of " + subject + ", not stapling");
+                return nullptr;
+            }
+
+            std::string url = options_.responder_url;
+            if (url.empty())
+            {
+                STACK_OF(OPENSSL_STRING) *urls = X509_get1_ocsp(leaf);
+                if (urls != nullptr && sk_OPENSSL_STRING_num(urls) > 0)
+                {
+                    url = sk_OPENSSL_STRING_value(urls, 0);
+                }
+                X509_email_free(urls);
+            }
+            if (url.empty())
+            {
+                log_("OCSP: no responder URL in " + subject + ", not stapling");
+                return nullptr;
+            }
+
+            auto entry = std::make_shared<Entry>();
+            entry->name = name;
+            X509_up_ref(leaf);
+            entry->leaf = leaf;
+            X509_up_ref(issuer);
+            entry->issuer = issuer;
+            entry->url = url;
+            return entry;
+        }
+
+        static std::string subject_name(X509 *certificate)
+        {
+            char buffer[256];
+            X509_NAME_oneline(X509_get_subject_name(certificate), buffer, sizeof(buffer));
+            return buffer;
+        }
+
+        static int status_callback(SSL *ssl, void *arg)
+        {
+            auto *self = static_cast<OcspStapler *>(arg);
+            auto map = std::atomic_load(&self->map_);
+            auto it = map->find(SSL_get_certificate(ssl));
+            if (it == map->end())
+            {
+                return SSL_TLSEXT_ERR_NOACK;
+            }
+
+            auto staple = std::atomic_load(&it->second->staple);
+            if (!staple || staple->expires <= std::time(nullptr))
+            {
+                return SSL_TLSEXT_ERR_NOACK;
+            }
+
+            // OpenSSL takes ownership of the copy
+            void *copy = OPENSSL_memdup(staple->der.data(), staple->der.size());
+            if (copy == nullptr)
+            {
+                return SSL_TLSEXT_ERR_NOACK;
+            }
+            SSL_set_tlsext_status_ocsp_resp(ssl, static_cast<unsigned char *>(copy),
+                                            static_cast<long>(staple->der.size()));
+            return SSL_TLSEXT_ERR_OK;
+        }
+
+        void refresh_loop()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!stopping_)
+            {
+                std::time_t now = std::time(nullptr);
+                std::time_t next = now + options_.default_refresh.count();
+                auto map = std::atomic_load(&map_);
+                for (const auto &item : *map)
+                {
+                    Entry &entry = *item.second;
+                    if (entry.next_refresh <= now)
+                    {
+                        lock.unlock();
+                        refresh(entry);
+                        lock.lock();
+                        if (stopping_)
+                        {
+                            return;
+                        }
+                    }
+                    next = std::min(next, entry.next_refresh);
+                }
+
+                // attach() wakes us early for new certificates
+                wake_.wait_for(lock, std::chrono::seconds(std::max<std::time_t>(next - std::time(nullptr), 1)));
+            }
+        }
+
+        void refresh(Entry &entry)
+        {
+            std::time_t now = std::time(nullptr);
+            try
+            {
+                std::time_t this_update = 0;
+                std::time_t next_update = 0;
+                std::string der = fetch(entry, this_update, next_update);
+
+                auto staple = std::make_shared<const Staple>(
+                    Staple{std::move(der), next_update != 0 ? next_update : now + options_.default_refresh.count()});
+                std::atomic_store(&entry.staple, staple);
+
+                // Halfway to nextUpdate, so several retries fit before expiry
+                std::time_t refresh_in = next_update != 0 ? (next_update - now) / 2 : options_.default_refresh.count();
+                entry.next_refresh = now + std::max<std::time_t>(refresh_in, options_.retry_interval.count());
+                log_("OCSP: stapling response for " + subject_name(entry.leaf));
+            }
+            catch (const std::exception &e)
+            {
+                entry.next_refresh = now + options_.retry_interval.count();
+                log_("OCSP: " + subject_name(entry.leaf) + ": " + e.what());
+            }
+        }
+
+        // Fetches and verifies a response; returns it DER encoded
+        std::string fetch(const Entry &entry, std::time_t &this_update, std::time_t &next_update) const
+        {
+            std::unique_ptr<OCSP_CERTID, decltype(&OCSP_CERTID_free)> id(
+                OCSP_cert_to_id(nullptr, entry.leaf, entry.issuer), OCSP_CERTID_free);
+            std::unique_ptr<OCSP_REQUEST, decltype(&OCSP_REQUEST_free)> request(OCSP_REQUEST_new(),
+                                                                                OCSP_REQUEST_free);
+            if (!id || !request || OCSP_request_add0_id(request.get(), OCSP_CERTID_dup(id.get())) == nullptr)
+            {
+                throw std::runtime_error("cannot build request");
+            }
+
+            unsigned char *encoded = nullptr;
+            int encoded_length = i2d_OCSP_REQUEST(request.get(), &encoded);
+            if (encoded_length <= 0)
+            {
+                throw std::runtime_error("cannot encode request");
+            }
+            std::string body(reinterpret_cast<char *>(encoded), static_cast<std::size_t>(encoded_length));
+            OPENSSL_free(encoded);
+
+            std::string reply = post(entry.url, body);
+            const auto *cursor = reinterpret_cast<const unsigned char *>(reply.data());
+            std::unique_ptr<OCSP_RESPONSE, decltype(&OCSP_RESPONSE_free)> response(
+                d2i_OCSP_RESPONSE(nullptr, &cursor, static_cast<long>(reply.size())), OCSP_RESPONSE_free);
+            if (!response)
+            {
+                throw std::runtime_error("unparsable response");
+            }
+            if (OCSP_response_status(response.get()) != OCSP_RESPONSE_STATUS_SUCCESSFUL)
+            {
+                throw std::runtime_error(std::string("responder said ") +
+                                         OCSP_response_status_str(OCSP_response_status(response.get())));
+            }
+
+            std::unique_ptr<OCSP_BASICRESP, decltype(&OCSP_BASICRESP_free)> basic(
+                OCSP_response_get1_basic(response.get()), OCSP_BASICRESP_free);
+            std::unique_ptr<X509_STORE, decltype(&X509_STORE_free)> store(X509_STORE_new(), X509_STORE_free);
+            std::unique_ptr<STACK_OF(X509), void (*)(STACK_OF(X509) *)>
+                issuer(sk_X509_new_null(), [](STACK_OF(X509) *stack)
+                       { sk_X509_free(stack); });
+            if (!basic || !store || !issuer)
+            {
+                throw std::runtime_error("out of memory");
+            }
+
+            // The issuer is the trust anchor, whether it signs itself or
+            // delegates to a responder certificate
+            X509_STORE_add_cert(store.get(), entry.issuer);
+            X509_STORE_set_flags(store.get(), X509_V_FLAG_PARTIAL_CHAIN);
+            sk_X509_push(issuer.get(), entry.issuer);
+            if (OCSP_basic_verify(basic.get(), issuer.get(), store.get(), 0) <= 0)
+            {
+                ERR_clear_error();
+                throw std::runtime_error("signature does not verify");
+            }
+
+            int status = 0;
+            int reason = 0;
+            ASN1_GENERALIZEDTIME *revoked = nullptr;
+            ASN1_GENERALIZEDTIME *this_time = nullptr;
+            ASN1_GENERALIZEDTIME *next_time = nullptr;
+            if (OCSP_resp_find_status(basic.get(), id.get(), &status, &reason, &revoked, &this_time, &next_time) !=
+                1)
+            {
+                throw std::runtime_error("response does not cover the certificate");
+            }
+            if (OCSP_check_validity(this_time, next_time, 300, -1) != 1)
+            {
+                ERR_clear_error();
+                throw std::runtime_error("response is outside its validity period");
+            }
+            if (status != V_OCSP_CERTSTATUS_GOOD)
+            {
+                // Still stapled: clients should learn about a revocation
+                log_("OCSP: certificate " + subject_name(entry.leaf) + " is " + OCSP_cert_status_str(status));
+            }
+
+            this_update = to_time(this_time);
+            next_update = next_time != nullptr ? to_time(next_time) : 0;
+            return reply;
+        }
+
+        static std::time_t to_time(const ASN1_GENERALIZEDTIME *time)
+        {
+            std::tm tm_utc{};
+            if (time == nullptr || ASN1_TIME_to_tm(time, &tm_utc) != 1)
+            {
+                return 0;
+            }
+            return timegm(&tm_utc);
+        }
+
+        // Minimal HTTP/1.0 POST; returns the response body
+        std::string post(const std::string &url, const std::string &body) const
+        {
+            char *host = nullptr;
+            char *port = nullptr;
+            char *path = nullptr;
+            int use_ssl = 0;
+            if (OCSP_parse_url(url.c_str(), &host, &port, &path, &use_ssl) != 1)
+            {
+                throw std::runtime_error("bad responder URL " + url);
+            }
+            std::string host_name = host;
+            std::string port_name = port;
+            std::string path_name = path;
+            OPENSSL_free(host);
+            OPENSSL_free(port);
+            OPENSSL_free(path);
+            if (use_ssl)
+            {
+                throw std::runtime_error("https responders are not supported: " + url);
+            }
+
+            int fd = connect_with_timeout(host_name, port_name);
+            std::string request = "POST " + path_name + " HTTP/1.0\r\nHost: " + host_name +
+                                  "\r\nContent-Type: application/ocsp-request\r\nContent-Length: " +
+                                  std::to_string(body.size()) + "\r\n\r\n" + body;
+            std::string reply;
+            bool sent = send_all(fd, request);
+            char buffer[4096];
+            ssize_t length;
+            while (sent && (length = recv(fd, buffer, sizeof(buffer), 0)) > 0 && reply.size() < (1 << 20))
+            {
+                reply.append(buffer, static_cast<std::size_t>(length));
+            }
+            close(fd);
+
+            std::size_t head_end = reply.find("\r\n\r\n");
+            if (!sent || head_end == std::string::npos)
+            {
+                throw std::runtime_error("no response from " + url);
+            }
+            if (reply.compare(0, 9, "HTTP/1.0 ") != 0 && reply.compare(0, 9, "HTTP/1.1 ") != 0)
+            {
+                throw std::runtime_error("not an HTTP response from " + url);
+            }
+            if (reply.compare(9, 3, "200") != 0)
+            {
+                throw std::runtime_error("HTTP " + reply.substr(9, 3) + " from " + url);
+            }
+            return reply.substr(head_end + 4);
+        }
+
+        int connect_with_timeout(const std::string &host, const std::string &port) const
+        {
+            addrinfo hints{};
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            addrinfo *addresses = nullptr;
+            if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0)
+            {
+                throw std::runtime_error("cannot resolve " + host);
+            }
+
+            int timeout_ms = static_cast<int>(options_.timeout.count() * 1000);
+            int fd = -1;
+            for (addrinfo *a = addresses; a != nullptr && fd < 0; a = a->ai_next)
+            {
+                fd = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, a->ai_protocol);
+                if (fd < 0)
+                {
+                    continue;
+                }
+                pollfd pfd{fd, POLLOUT, 0};
+                int error = 0;
+                socklen_t error_length = sizeof(error);
+                if ((connect(fd, a->ai_addr, a->ai_addrlen) < 0 &&
+                     (errno != EINPROGRESS || poll(&pfd, 1, timeout_ms) != 1 ||
+                      getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_length) < 0 || error != 0)))
+                {
+                    close(fd);
+                    fd = -1;
+                }
+            }
+            freeaddrinfo(addresses);
+            if (fd < 0)
+            {
+                throw std::runtime_error("cannot connect to " + host + ":" + port);
+            }
+
+            // Back to blocking, with timeouts on every read and write
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+            timeval tv{static_cast<time_t>(options_.timeout.count()), 0};
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+            return fd;
+        }
+
+        static bool send_all(int fd, const std::string &data)
+        {
+            std::size_t sent = 0;
+            while (sent < data.size())
+            {
+                ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+                if (n <= 0)
+                {
+                    return false;
+                }
+                sent += static_cast<std::size_t>(n);
+            }
+            return true;
+        }
+    };
+
+} // namespace tls
+
+#endif // TLS_OCSP_H
@@ -0,0 +1,153 @@
+#ifndef TLS_PROFILE_H
+#define TLS_PROFILE_H
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Protocol, cipher and key-exchange profiles for the HTTPS examples, after
+// the Mozilla server-side TLS recommendations.
+//
+//  - modern: TLS 1.3 only. One-round-trip handshakes, AEAD ciphers only.
+//  - intermediate: TLS 1.2 and 1.3 with ECDHE and AEAD ciphers; the default.
+//  - legacy: down to TLS 1.0 and CBC ciphers, for old embedded clients.
+//
+// Every profile prefers X25519 for key exchange. A context may hold an RSA
+// and an ECDSA certificate at once; OpenSSL signs with ECDSA for clients that
+// support it, which is much cheaper for the server than an RSA signature.
+//
+// 0-RTT early data is not offered. Crow reads through asio's SSL stream,
+// which never calls SSL_read_early_data(), so the server could only discard
+// it, and handlers cannot tell which requests arrived before the handshake
+// finished, which limiting 0-RTT to idempotent GETs would need.
+namespace tls
+{
+
+    enum class Profile
+    {
+        Modern,
+        Intermediate,
+        Legacy
+    };
+
+    inline const char *profile_name(Profile profile)
+    {
+        switch (profile)
+        {
+        case Profile::Modern: return "modern";
+        case Profile::Intermediate: return "intermediate";
+        case Profile::Legacy: return "legacy";
+        }
+        return "unknown";
+    }
+
+    inline bool parse_profile(const std::string &name, Profile &profile)
+    {
+        for (Profile candidate : {Profile::Modern, Profile::Intermediate, Profile::Legacy})
+        {
+            if (name == profile_name(candidate))
+            {
+                profile = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    struct CertificateFiles
+    {
+        std::string certificate_chain; // PEM, leaf first
+        std::string private_key;       // PEM
+    };
+
+    namespace detail
+    {
+
+        inline void check(int result, const std::string &what)
+        {
+            if (result != 1)
+            {
+                unsigned long error = ERR_get_error();
+                char reason[256] = "unknown error";
+                if (error != 0)
+                {
+                    ERR_error_string_n(error, reason, sizeof(reason));
+                }
+                ERR_clear_error();
+                throw std::runtime_error(what + ": " + reason);
+            }
+        }
+
+    } // namespace detail
+
+    // Sets protocol versions, ciphers and groups; throws std::runtime_error
+    // if OpenSSL rejects any of them
+    inline void apply_profile(SSL_CTX *ctx, Profile profile)
+    {
+        const char *groups = "X25519:prime256v1:secp384r1";
+        const char *tls13_ciphers = "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256";
+
+        SSL_CTX_set_options(ctx, SSL_OP_NO_COMPRESSION | SSL_OP_NO_RENEGOTIATION);
+
+        switch (profile)
+        {
+        case Profile::Modern:
+            detail::check(SSL_CTX_set_min_proto_version(ctx, TLS1_3_VERSION), "min protocol");
+            detail::check(SSL_CTX_set_max_proto_version(ctx, 0), "max protocol");
+            // Every TLS 1.3 suite is strong; let clients without AES
+            // hardware pick ChaCha20
+            SSL_CTX_clear_options(ctx, SSL_OP_CIPHER_SERVER_PREFERENCE);
+            break;
+
+        case Profile::Intermediate:
+            detail::check(SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION), "min protocol");
+            detail::check(SSL_CTX_set_max_proto_version(ctx, 0), "max protocol");
+            detail::check(SSL_CTX_set_cipher_list(ctx, "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:"
+                                                       "ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384:"
+                                                       "ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-CHACHA20-POLY1305"),
+                          "cipher list");
+            SSL_CTX_clear_options(ctx, SSL_OP_CIPHER_SERVER_PREFERENCE);
+            break;
+
+        case Profile::Legacy:
+            // TLS 1.0/1.1 and SHA-1 signatures need security level 0 on OpenSSL 3
+            detail::check(SSL_CTX_set_min_proto_version(ctx, TLS1_VERSION), "min protocol");
+            detail::check(SSL_CTX_set_max_proto_version(ctx, 0), "max protocol");
+            detail::check(SSL_CTX_set_cipher_list(ctx, "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:"
+                                                       "ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384:"
+                                                       "ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-CHACHA20-POLY1305:"
+                                                       "ECDHE-ECDSA-AES128-SHA256:ECDHE-RSA-AES128-SHA256:"
+                                                       "ECDHE-ECDSA-AES128-SHA:ECDHE-RSA-AES128-SHA:"
+                                                       "ECDHE-ECDSA-AES256-SHA:ECDHE-RSA-AES256-SHA:"
+                                                       "AES128-GCM-SHA256:AES256-GCM-SHA384:AES128-SHA:AES256-SHA:"
+                                                       "@SECLEVEL=0"),
+                          "cipher list");
+            // Old clients list weak ciphers first
+            SSL_CTX_set_options(ctx, SSL_OP_CIPHER_SERVER_PREFERENCE);
+            break;
+        }
+
+        detail::check(SSL_CTX_set_ciphersuites(ctx, tls13_ciphers), "TLS 1.3 ciphersuites");
+        detail::check(SSL_CTX_set1_groups_list(ctx, groups), "groups");
+    }
+
+    // Loads one or more certificate/key pairs of different key types (e.g.
+    // RSA and ECDSA) into ctx; throws std::runtime_error on the first failure
+    inline void load_certificates(SSL_CTX *ctx, const std::vector<CertificateFiles> &files)
+    {
+        for (const auto &pair : files)
+        {
+            detail::check(SSL_CTX_use_certificate_chain_file(ctx, pair.certificate_chain.c_str()),
+                          "certificate " + pair.certificate_chain);
+            detail::check(SSL_CTX_use_PrivateKey_file(ctx, pair.private_key.c_str(), SSL_FILETYPE_PEM),
+                          "private key " + pair.private_key);
+            detail::check(SSL_CTX_check_private_key(ctx), "key does not match " + pair.certificate_chain);
+        }
+    }
+
+} // namespace tls
+
+#endif // TLS_PROFILE_H
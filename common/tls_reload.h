@@ -0,0 +1,208 @@
+#ifndef TLS_RELOAD_H
+#define TLS_RELOAD_H
+
+#include "tls_sni.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Certificate hot reload for the HTTPS examples.
+//
+// Watches the directories holding the certificate and key files of a
+// CertificateStore with inotify. When a watched file changes, the entry is
+// rebuilt through CertificateStore::add(), which validates the new chain
+// and key before swapping it in. New handshakes use the new certificate,
+// and connections already established keep theirs, so renewals need no
+// restart and cause no reconnection storm.
+//
+// Renewal tools write the certificate and the key one after the other, and
+// they either rewrite files in place or rename new ones over them (certbot
+// renames symlinks). Changes are therefore collected until the directory has
+// been quiet for settle_delay, and then each affected entry is reloaded
+// once. A reload that fails validation is reported and the previous
+// certificate stays in use.
+namespace tls
+{
+
+    class CertificateWatcher
+    {
+    public:
+        using Logger = std::function<void(const std::string &)>;
+
+        explicit CertificateWatcher(CertificateStore &store, int settle_delay_ms = 500,
+                                    Logger log = [](const std::string &message)
+                                    { std::cerr << message << std::endl; })
+            : store_(store), settle_delay_ms_(settle_delay_ms), log_(std::move(log))
+        {
+            inotify_fd_ = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+            stop_fd_ = eventfd(0, EFD_CLOEXEC);
+            if (inotify_fd_ < 0 || stop_fd_ < 0)
+            {
+                log_(std::string("certificate reload disabled: ") + std::strerror(errno));
+            }
+        }
+
+        ~CertificateWatcher()
+        {
+            if (watcher_.joinable())
+            {
+                std::uint64_t one = 1;
+                ssize_t written = write(stop_fd_, &one, sizeof(one));
+                (void)written;
+                watcher_.join();
+            }
+            if (stop_fd_ >= 0)
+            {
+                close(stop_fd_);
+            }
+            if (inotify_fd_ >= 0)
+            {
+                close(inotify_fd_);
+            }
+        }
+
+        CertificateWatcher(const CertificateWatcher &) = delete;
+        CertificateWatcher &operator=(const CertificateWatcher &) = delete;
+
+        // Reloads pattern (as passed to CertificateStore::add) whenever one
+        // of its files changes. Call before start().
+        void watch(const std::string &pattern, const std::vector<CertificateFiles> &files)
+        {
+            if (inotify_fd_ < 0)
+            {
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            entries_[pattern] = files;
+            for (const auto &pair : files)
+            {
+                for (const std::string &path : {pair.certificate_chain, pair.private_key})
+                {
+                    std::size_t slash = path.rfind('/');
+                    std::string directory = slash == std::string::npos ? "." : path.substr(0, slash);
+                    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+
+                    // IN_CREATE catches symlinks made in place of the old ones
+                    int wd = inotify_add_watch(inotify_fd_, directory.c_str(),
+                                               IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+                    if (wd < 0)
+                    {
+                        log_("cannot watch " + directory + ": " + std::strerror(errno));
+                        continue;
+                    }
+                    watched_[wd][name].insert(pattern);
+                }
+            }
+        }
+
+        void start()
+        {
+            if (inotify_fd_ >= 0 && stop_fd_ >= 0 && !watcher_.joinable())
+            {
+                watcher_ = std::thread([this]
+                                       { watch_loop(); });
+            }
+        }
+
+    private:
+        CertificateStore &store_;
+        int settle_delay_ms_;
+        Logger log_;
+        int inotify_fd_ = -1;
+        int stop_fd_ = -1;
+        std::thread watcher_;
+
+        std::mutex mutex_;
+        std::map<std::string, std::vector<CertificateFiles>> entries_;           // pattern -> files
+        std::map<int, std::map<std::string, std::set<std::string>>> watched_; // wd -> file -> patterns
+
+        void reload(const std::string &pattern)
+        {
+            std::vector<CertificateFiles> files;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                files = entries_[pattern];
+            }
+
+            try
+            {
+                store_.add(pattern, files);
+                log_("reloaded certificates for " + pattern);
+            }
+            catch (const std::exception &e)
+            {
+                log_("keeping previous certificates for " + pattern + ": " + e.what());
+            }
+        }
+
+        void watch_loop()
+        {
+            alignas(inotify_event) char buffer[4096];
+            std::set<std::string> pending;
+
+            while (true)
+            {
+                pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+                int ready = poll(fds, 2, pending.empty() ? -1 : settle_delay_ms_);
+                if (ready < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    return;
+                }
+                if (fds[1].revents & POLLIN)
+                {
+                    return;
+                }
+
+                // Quiet for settle_delay: both files of a pair are in place
+                if (ready == 0)
+                {
+                    for (const auto &pattern : pending)
+                    {
+                        reload(pattern);
+                    }
+                    pending.clear();
+                    continue;
+                }
+
+                ssize_t length = read(inotify_fd_, buffer, sizeof(buffer));
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (ssize_t offset = 0; offset < length;)
+                {
+                    const auto *event = reinterpret_cast<const inotify_event *>(buffer + offset);
+                    auto directory = watched_.find(event->wd);
+                    if (event->len > 0 && directory != watched_.end())
+                    {
+                        auto file = directory->second.find(event->name);
+                        if (file != directory->second.end())
+                        {
+                            pending.insert(file->second.begin(), file->second.end());
+                        }
+                    }
+                    offset += sizeof(inotify_event) + event->len;
+                }
+            }
+        }
+    };
+
+} // namespace tls
+
+#endif // TLS_RELOAD_H
@@ -0,0 +1,282 @@
+#ifndef TLS_SESSION_H
+#define TLS_SESSION_H
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
+
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+// TLS session resumption for the HTTPS examples.
+//
+// A resumed handshake skips the certificate exchange and the expensive
+// private-key operation, so short-lived clients that reconnect cost a
+// fraction of a full handshake. Two mechanisms are enabled:
+//
+//  - a server-side session cache, for clients that resume by session ID
+//    (and for TLS 1.3 when tickets are off);
+//  - session tickets, encrypted with keys the server generates itself and
+//    rotates on a timer. The previous key is kept so tickets issued just
+//    before a rotation still resume, and such tickets are renewed.
+//
+// Ticket keys live only in memory: a restart invalidates outstanding
+// tickets, which is the safe default for keys nobody else must learn.
+namespace tls
+{
+
+    struct SessionOptions
+    {
+        long cache_size = 20480;                        // sessions kept in the server cache
+        std::chrono::seconds session_lifetime{300};     // how long a session may be resumed
+        bool tickets = true;                            // stateless resumption
+        std::chrono::seconds ticket_key_rotation{3600}; // new ticket key this often
+    };
+
+    struct SessionStats
+    {
+        long accepts;    // handshakes completed
+        long hits;       // resumed from the cache or a ticket
+        long misses;     // session ID offered but not in the cache
+        long timeouts;   // offered session had expired
+        long cache_full; // sessions evicted because the cache was full
+        long cached;     // sessions in the cache now
+    };
+
+    inline SessionStats session_stats(SSL_CTX *ctx)
+    {
+        return SessionStats{SSL_CTX_sess_accept_good(ctx), SSL_CTX_sess_hits(ctx), SSL_CTX_sess_misses(ctx),
+                            SSL_CTX_sess_timeouts(ctx), SSL_CTX_sess_cache_full(ctx), SSL_CTX_sess_number(ctx)};
+    }
+
+    namespace detail
+    {
+
+        struct TicketKey
+        {
+            unsigned char name[16];
+            unsigned char aes_key[32];
+            unsigned char hmac_key[32];
+            std::time_t created = 0;
+        };
+
+        // Current and previous ticket keys, shared by the SSL_CTXs that
+        // resume each other's sessions
+        class TicketKeyRing
+        {
+        public:
+            explicit TicketKeyRing(std::chrono::seconds rotation) : rotation_(rotation)
+            {
+                generate(current_);
+            }
+
+            // Key to encrypt new tickets with, rotating it if it is due
+            TicketKey current()
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (rotation_.count() > 0 && std::time(nullptr) - current_.created >= rotation_.count())
+                {
+                    previous_ = current_;
+                    has_previous_ = true;
+                    generate(current_);
+                }
+                return current_;
+            }
+
+            // Key a ticket was encrypted with; 0 if unknown, 2 if it
+            // should be renewed with the current key
+            int find(const unsigned char *name, TicketKey &key)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (std::memcmp(name, current_.name, sizeof(current_.name)) == 0)
+                {
+                    key = current_;
+                    return 1;
+                }
+                if (has_previous_ && std::memcmp(name, previous_.name, sizeof(previous_.name)) == 0)
+                {
+                    key = previous_;
+                    return 2;
+                }
+                return 0;
+            }
+
+        private:
+            std::chrono::seconds rotation_;
+            std::mutex mutex_;
+            TicketKey current_;
+            TicketKey previous_;
+            bool has_previous_ = false;
+
+            static void generate(TicketKey &key)
+            {
+                if (RAND_bytes(key.name, sizeof(key.name)) != 1 ||
+                    RAND_bytes(key.aes_key, sizeof(key.aes_key)) != 1 ||
+                    RAND_bytes(key.hmac_key, sizeof(key.hmac_key)) != 1)
+                {
+                    throw std::runtime_error("RAND_bytes failed");
+                }
+                key.created = std::time(nullptr);
+            }
+        };
+
+        // Sessions are only resumed by contexts with the same ID context
+        inline void set_session_id_context(SSL_CTX *ctx)
+        {
+            static const unsigned char session_id_context[] = "crow-examples";
+            SSL_CTX_set_session_id_context(ctx, session_id_context, sizeof(session_id_context) - 1);
+        }
+
+        using KeyRingHandle = std::shared_ptr<TicketKeyRing>;
+
+        inline void free_key_ring(void *, void *ptr, CRYPTO_EX_DATA *, int, long, void *)
+        {
+            delete static_cast<KeyRingHandle *>(ptr);
+        }
+
+        inline int key_ring_index()
+        {
+            static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, free_key_ring);
+            return index;
+        }
+
+        inline KeyRingHandle *key_ring_handle(SSL_CTX *ctx)
+        {
+            return static_cast<KeyRingHandle *>(SSL_CTX_get_ex_data(ctx, key_ring_index()));
+        }
+
+        inline void set_key_ring(SSL_CTX *ctx, KeyRingHandle ring)
+        {
+            delete key_ring_handle(ctx);
+            SSL_CTX_set_ex_data(ctx, key_ring_index(), ring ? new KeyRingHandle(std::move(ring)) : nullptr);
+        }
+
+        // The SSL's current context, which SNI may have switched
+        inline TicketKeyRing *key_ring(SSL *ssl)
+        {
+            KeyRingHandle *handle = key_ring_handle(SSL_get_SSL_CTX(ssl));
+            return handle == nullptr ? nullptr : handle->get();
+        }
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        using TicketMacCtx = EVP_MAC_CTX;
+
+        inline bool init_ticket_mac(TicketMacCtx *mac, unsigned char *key, std::size_t length)
+        {
+            char digest[] = "SHA256";
+            OSSL_PARAM params[] = {OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key, length),
+                                   OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+                                   OSSL_PARAM_construct_end()};
+            return EVP_MAC_CTX_set_params(mac, params) == 1;
+        }
+#else
+        using TicketMacCtx = HMAC_CTX;
+
+        inline bool init_ticket_mac(TicketMacCtx *mac, unsigned char *key, std::size_t length)
+        {
+            return HMAC_Init_ex(mac, key, static_cast<int>(length), EVP_sha256(), nullptr) == 1;
+        }
+#endif
+
+        inline int ticket_key_callback(SSL *ssl, unsigned char key_name[16], unsigned char *iv,
+                                       EVP_CIPHER_CTX *cipher, TicketMacCtx *mac, int encrypt)
+        {
+            TicketKeyRing *ring = key_ring(ssl);
+            if (ring == nullptr)
+            {
+                return -1;
+            }
+
+            TicketKey key;
+            if (encrypt)
+            {
+                key = ring->current();
+                std::memcpy(key_name, key.name, sizeof(key.name));
+                if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1 ||
+                    EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aes_key, iv) != 1 ||
+                    !init_ticket_mac(mac, key.hmac_key, sizeof(key.hmac_key)))
+                {
+                    return -1;
+                }
+                return 1;
+            }
+
+            // Unknown key: fall back to a full handshake
+            int found = ring->find(key_name, key);
+            if (found == 0)
+            {
+                return 0;
+            }
+            if (!init_ticket_mac(mac, key.hmac_key, sizeof(key.hmac_key)) ||
+                EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aes_key, iv) != 1)
+            {
+                return -1;
+            }
+
+            // TLS 1.3 clients use a ticket once, so always hand out a new one
+            return SSL_version(ssl) >= TLS1_3_VERSION ? 2 : found;
+        }
+
+        inline void set_ticket_callback(SSL_CTX *ctx)
+        {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+            SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, ticket_key_callback);
+#else
+            SSL_CTX_set_tlsext_ticket_key_cb(ctx, ticket_key_callback);
+#endif
+        }
+
+    } // namespace detail
+
+    // Enables the session cache and, unless disabled, rotating session
+    // tickets on ctx. Call once per context, before it serves connections.
+    inline void enable_session_resumption(SSL_CTX *ctx, const SessionOptions &options = SessionOptions())
+    {
+        detail::set_session_id_context(ctx);
+
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(ctx, options.cache_size);
+        SSL_CTX_set_timeout(ctx, static_cast<long>(options.session_lifetime.count()));
+
+        if (!options.tickets)
+        {
+            SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+            return;
+        }
+
+        SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+        detail::set_key_ring(ctx, std::make_shared<detail::TicketKeyRing>(options.ticket_key_rotation));
+        detail::set_ticket_callback(ctx);
+    }
+
+    // Makes sessions from one context resumable on another: same session ID
+    // context, lifetime and ticket keys. Used for the per-hostname contexts
+    // SNI switches to, since tickets are decrypted with the switched-to
+    // context's keys.
+    inline void share_session_resumption(SSL_CTX *from, SSL_CTX *to)
+    {
+        detail::set_session_id_context(to);
+        SSL_CTX_set_timeout(to, SSL_CTX_get_timeout(from));
+        detail::KeyRingHandle *ring = detail::key_ring_handle(from);
+        if (ring == nullptr || (SSL_CTX_get_options(from) & SSL_OP_NO_TICKET) != 0)
+        {
+            SSL_CTX_set_options(to, SSL_OP_NO_TICKET);
+            return;
+        }
+        SSL_CTX_clear_options(to, SSL_OP_NO_TICKET);
+        detail::set_key_ring(to, *ring);
+        detail::set_ticket_callback(to);
+    }
+
+} // namespace tls
+
+#endif // TLS_SESSION_H
@@ -0,0 +1,237 @@
+#ifndef TLS_SNI_H
+#define TLS_SNI_H
+
+#include "tls_profile.h"
+#include "tls_session.h"
+
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Certificate selection by SNI hostname for the HTTPS examples.
+//
+// One process can terminate TLS for many hostnames. Each hostname, or a
+// wildcard pattern like "*.example.com", gets its own SSL_CTX holding one
+// or more certificate chains (typically RSA and ECDSA). During the
+// ClientHello the server name is looked up and the connection switches to
+// that context. Clients that send no name, or an unknown one, get the "*"
+// entry if there is one, and otherwise keep the default context and its
+// certificate. Any entry can be replaced while the server runs: new
+// handshakes pick up the new context, while connections already on the old
+// one keep it until they close.
+//
+// Lookup costs at most two hash probes: the exact name, then the name with
+// its first label replaced by "*". Following RFC 6125, a wildcard matches
+// exactly one label, so "*.example.com" matches "a.example.com" but not
+// "example.com" or "a.b.example.com".
+namespace tls
+{
+
+    // What add() does with a chain outside its validity period
+    enum class Validity
+    {
+        Enforce, // reject it
+        Warn     // log it and use the chain anyway
+    };
+
+    class CertificateStore
+    {
+    public:
+        using Logger = std::function<void(const std::string &)>;
+
+        // default_ctx serves clients without a matching name; its protocol
+        // and cipher settings apply to every connection, and session
+        // resumption is shared with the per-hostname contexts. The store
+        // must outlive every connection on default_ctx.
+        explicit CertificateStore(SSL_CTX *default_ctx,
+                                  Logger log = [](const std::string &message)
+                                  { std::cerr << message << std::endl; })
+            : default_ctx_(default_ctx), log_(std::move(log)), table_(std::make_shared<const Table>())
+        {
+        }
+
+        CertificateStore(const CertificateStore &) = delete;
+        CertificateStore &operator=(const CertificateStore &) = delete;
+
+        // Called with each validated context just before it goes live, e.g.
+        // to attach OCSP stapling. Set it before the first add().
+        using Listener = std::function<void(const std::string &pattern, SSL_CTX *ctx)>;
+
+        void set_listener(Listener listener)
+        {
+            listener_ = std::move(listener);
+        }
+
+        // Adds or replaces the certificates for a hostname, a "*.domain"
+        // pattern, or "*" for every other name. The new context is only
+        // activated once every chain loads, matches its key and is within
+        // its validity period; otherwise std::runtime_error is thrown and
+        // the previous certificates for the pattern stay in use.
+        //
+        // Validity::Warn only logs an expired or not yet valid chain. It is
+        // meant for the first load at startup, where refusing to start
+        // would leave no certificate at all; reloads keep enforcing, so a
+        // stale renewal never replaces a working certificate.
+        void add(const std::string &pattern, const std::vector<CertificateFiles> &files,
+                 Validity validity = Validity::Enforce)
+        {
+            ContextPtr ctx(SSL_CTX_new(TLS_server_method()), SSL_CTX_free);
+            if (!ctx)
+            {
+                throw std::runtime_error("SSL_CTX_new failed");
+            }
+            load_certificates(ctx.get(), files);
+            std::string problem = validity_problem(ctx.get());
+            if (!problem.empty())
+            {
+                if (validity == Validity::Enforce)
+                {
+                    throw std::runtime_error(problem);
+                }
+                log_("using certificates for " + pattern + " anyway: " + problem);
+            }
+            share_session_resumption(default_ctx_, ctx.get());
+
+            std::string name = lowercase(pattern);
+            if (listener_)
+            {
+                listener_(name, ctx.get());
+            }
+
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            auto table = std::make_shared<Table>(*std::atomic_load(&table_));
+            if (name == "*")
+            {
+                table->fallback = std::move(ctx);
+            }
+            else if (name.compare(0, 2, "*.") == 0)
+            {
+                table->wildcard[name.substr(2)] = std::move(ctx);
+            }
+            else
+            {
+                table->exact[name] = std::move(ctx);
+            }
+            std::atomic_store(&table_, std::shared_ptr<const Table>(std::move(table)));
+        }
+
+        // Starts switching contexts by SNI on default_ctx
+        void install()
+        {
+            SSL_CTX_set_tlsext_servername_callback(default_ctx_, servername_callback);
+            SSL_CTX_set_tlsext_servername_arg(default_ctx_, this);
+        }
+
+        std::size_t size() const
+        {
+            auto table = std::atomic_load(&table_);
+            return table->exact.size() + table->wildcard.size() + (table->fallback ? 1 : 0);
+        }
+
+        using ContextPtr = std::shared_ptr<SSL_CTX>;
+
+        // Context for a server name ("" when the client sent none), or
+        // nullptr for the default context. The returned pointer keeps the
+        // context alive even if add() replaces it meanwhile.
+        ContextPtr find(const std::string &server_name) const
+        {
+            auto table = std::atomic_load(&table_);
+            std::string name = lowercase(server_name);
+
+            auto exact = table->exact.find(name);
+            if (exact != table->exact.end())
+            {
+                return exact->second;
+            }
+
+            std::size_t dot = name.find('.');
+            if (dot != std::string::npos && dot != 0)
+            {
+                auto wildcard = table->wildcard.find(name.substr(dot + 1));
+                if (wildcard != table->wildcard.end())
+                {
+                    return wildcard->second;
+                }
+            }
+            return table->fallback;
+        }
+
+    private:
+        // Replaced as a whole on every change, so handshakes read it
+        // without locking
+        struct Table
+        {
+            std::unordered_map<std::string, ContextPtr> exact;
+            std::unordered_map<std::string, ContextPtr> wildcard; // keyed by the domain after "*."
+            ContextPtr fallback;                                   // "*"
+        };
+
+        SSL_CTX *default_ctx_;
+        Logger log_;
+        Listener listener_;
+        std::shared_ptr<const Table> table_;
+        std::mutex write_mutex_;
+
+        static std::string lowercase(std::string name)
+        {
+            std::transform(name.begin(), name.end(), name.begin(),
+                           [](unsigned char c)
+                           { return static_cast<char>(std::tolower(c)); });
+            // A trailing dot names the same host
+            if (!name.empty() && name.back() == '.')
+            {
+                name.pop_back();
+            }
+            return name;
+        }
+
+        // Why a leaf certificate is expired or not yet valid, or "" if
+        // every chain is within its validity period
+        static std::string validity_problem(SSL_CTX *ctx)
+        {
+            for (long more = SSL_CTX_set_current_cert(ctx, SSL_CERT_SET_FIRST); more == 1;
+                 more = SSL_CTX_set_current_cert(ctx, SSL_CERT_SET_NEXT))
+            {
+                X509 *leaf = SSL_CTX_get0_certificate(ctx);
+                if (X509_cmp_current_time(X509_get0_notBefore(leaf)) > 0)
+                {
+                    return "certificate is not valid yet";
+                }
+                if (X509_cmp_current_time(X509_get0_notAfter(leaf)) < 0)
+                {
+                    return "certificate has expired";
+                }
+            }
+            return "";
+        }
+
+        // OpenSSL calls this for every ClientHello, with or without SNI
+        static int servername_callback(SSL *ssl, int *, void *arg)
+        {
+            const char *name = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+
+            // ctx holds the context until SSL_set_SSL_CTX has taken its own
+            // reference; after that a concurrent add() may drop it from the
+            // table without freeing it under this handshake
+            ContextPtr ctx = static_cast<CertificateStore *>(arg)->find(name == nullptr ? "" : name);
+            if (ctx)
+            {
+                SSL_set_SSL_CTX(ssl, ctx.get());
+            }
+            return name == nullptr ? SSL_TLSEXT_ERR_NOACK : SSL_TLSEXT_ERR_OK;
+        }
+    };
+
+} // namespace tls
+
+#endif // TLS_SNI_H